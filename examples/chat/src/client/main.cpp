@@ -35,7 +35,7 @@ int main() {
         wired::message<message_types> msg(message_types::client_message);
         msg << chatter.name;
         msg << message;
-        chatter.send(msg);
+        chatter.post(msg);
     }
 
     chatter.disconnect();
@@ -17,5 +17,5 @@ void server::on_message(message_t& msg, connection_ptr conn) {
 }
 
 void server::on_client_message(message_t& msg, connection_ptr conn) {
-    send_all(conn, msg);
+    post_all(conn, msg);
 }
\ No newline at end of file
@@ -27,7 +27,7 @@ struct client : client_interface<common_messages> {
                 return;
             }
             message<common_messages> msg(common_messages::client_ping);
-            send(msg);
+            post(msg);
 
             break;
         }
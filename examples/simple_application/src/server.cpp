@@ -16,7 +16,7 @@ class server : public server_interface<common_messages> {
             std::cout << "[server]: I got a ping from the client!\n";
             message_t answer{common_messages::server_ping};
             std::this_thread::sleep_for(std::chrono::seconds(1));
-            send(conn, answer);
+            post(conn, answer);
             break;
         }
         default: {
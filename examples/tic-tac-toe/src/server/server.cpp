@@ -19,7 +19,7 @@ void server::on_message(message_t& msg, connection_ptr conn) {
                   << std::endl;
         message_t response{message_types::client_hello};
         response << client_id;
-        send(conn, response);
+        post(conn, response);
         break;
     }
     case message_types::client_want_to_play: {
@@ -45,9 +45,9 @@ void server::on_message(message_t& msg, connection_ptr conn) {
                 message_t move_msg{message_types::client_move};
                 move_msg << player_id << row << col;
                 if (game.first == player_id) {
-                    send(clients[game.second], move_msg);
+                    post(clients[game.second], move_msg);
                 } else {
-                    send(clients[game.first], move_msg);
+                    post(clients[game.first], move_msg);
                 }
                 break;
             }
@@ -93,7 +93,7 @@ void server::check_if_game_can_start() {
         message_t start_game_msg{message_types::client_game_start};
         start_game_msg << player1_id << clients_name[player1_id] << player2_id
                        << clients_name[player2_id] << turn;
-        send(conn1, start_game_msg);
-        send(conn2, start_game_msg);
+        post(conn1, start_game_msg);
+        post(conn2, start_game_msg);
     }
 }
@@ -1,12 +1,23 @@
 #ifndef WIRED_H
 #define WIRED_H
 
+#include "wired/buffer_pool.h"
 #include "wired/client.h"
+#include "wired/compression.h"
 #include "wired/concepts.h"
 #include "wired/connection.h"
+#include "wired/context_pool.h"
+#include "wired/datagram.h"
+#include "wired/dispatcher.h"
 #include "wired/message.h"
+#include "wired/mpsc_queue.h"
+#include "wired/schema.h"
+#include "wired/send_scheduler.h"
 #include "wired/server.h"
+#include "wired/shm_stream.h"
+#include "wired/tls_session.h"
 #include "wired/tools/log.h"
+#include "wired/transport.h"
 #include "wired/ts_deque.h"
 #include "wired/types.h"
 
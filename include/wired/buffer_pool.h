@@ -0,0 +1,160 @@
+#ifndef WIRED_BUFFER_POOL_H
+#define WIRED_BUFFER_POOL_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace wired {
+
+/**
+ * @brief Size class pool of recycled message body buffers
+ * Buffers are grouped in power of two size classes from 64 bytes to 1 MiB,
+ * acquire hands out a buffer whose capacity already fits the requested size
+ * and release keeps the buffer for the next acquire of its class, so a
+ * steady stream of messages does not touch the heap. Larger buffers are
+ * neither pooled nor counted. The capacity of all kept buffers together
+ * stays within max_retained_bytes, a released buffer that does not fit is
+ * freed.
+ *
+ * acquire and release may be called from any thread.
+ */
+class buffer_pool {
+  public:
+    using buffer_t = std::vector<uint8_t>;
+
+  public:
+    explicit buffer_pool(std::size_t buffers_per_class = 64,
+                         std::size_t max_retained_bytes = 4 * 1024 * 1024);
+    buffer_pool(const buffer_pool& other) = delete;
+
+    buffer_pool& operator=(const buffer_pool& other) = delete;
+
+    buffer_t acquire(std::size_t size);
+    void release(buffer_t&& buffer);
+
+    std::size_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    std::size_t misses() const {
+        return misses_.load(std::memory_order_relaxed);
+    }
+    // Capacity of the buffers waiting for an acquire
+    std::size_t retained_bytes() const {
+        return retained_bytes_.load(std::memory_order_relaxed);
+    }
+
+    static constexpr std::size_t min_class_size = 64;
+    static constexpr std::size_t max_class_size = 1024 * 1024;
+
+  private:
+    struct size_class {
+        std::mutex mutex;
+        std::vector<buffer_t> free;
+    };
+
+    static constexpr std::size_t class_count_ = 15;
+
+    static std::size_t class_size(std::size_t index) {
+        return min_class_size << index;
+    }
+
+    bool retain(std::size_t bytes);
+
+  private:
+    std::array<size_class, class_count_> classes_;
+    std::size_t buffers_per_class_;
+    std::size_t max_retained_bytes_;
+    std::atomic<std::size_t> retained_bytes_;
+    std::atomic<std::size_t> hits_;
+    std::atomic<std::size_t> misses_;
+}; // class buffer_pool
+
+inline buffer_pool::buffer_pool(std::size_t buffers_per_class,
+                                std::size_t max_retained_bytes)
+    : classes_(), buffers_per_class_(buffers_per_class),
+      max_retained_bytes_(max_retained_bytes), retained_bytes_(0), hits_(0),
+      misses_(0) {
+    // Reserved up front so that release never allocates either
+    for (auto& cls : classes_) {
+        cls.free.reserve(buffers_per_class_);
+    }
+}
+
+/**
+ * @brief Get a buffer of exactly size bytes
+ * The contents of a recycled buffer are unspecified. A recycled buffer
+ * keeps the size it was released with and only the bytes past it are
+ * zeroed, so messages of a steady size are not filled at all.
+ */
+inline buffer_pool::buffer_t buffer_pool::acquire(std::size_t size) {
+    if (size > max_class_size) {
+        return buffer_t(size);
+    }
+    std::size_t index = 0;
+    while (class_size(index) < size) {
+        ++index;
+    }
+
+    auto& cls = classes_[index];
+    {
+        std::lock_guard<std::mutex> lock(cls.mutex);
+        if (!cls.free.empty()) {
+            buffer_t buffer = std::move(cls.free.back());
+            cls.free.pop_back();
+            retained_bytes_.fetch_sub(buffer.capacity(),
+                                      std::memory_order_relaxed);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            buffer.resize(size);
+            return buffer;
+        }
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    buffer_t buffer;
+    buffer.reserve(class_size(index));
+    buffer.resize(size);
+    return buffer;
+}
+
+/**
+ * @brief Hand a buffer back, it is filed under the largest class its
+ * capacity can serve and dropped when that class is already full or the
+ * pool would retain more than max_retained_bytes
+ */
+inline void buffer_pool::release(buffer_t&& buffer) {
+    std::size_t capacity = buffer.capacity();
+    if (capacity < min_class_size || capacity > max_class_size) {
+        return;
+    }
+    std::size_t index = 0;
+    while (index + 1 < class_count_ && class_size(index + 1) <= capacity) {
+        ++index;
+    }
+
+    auto& cls = classes_[index];
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    if (cls.free.size() < buffers_per_class_ && retain(capacity)) {
+        // Not cleared, the next acquire of a size up to this one is free
+        cls.free.push_back(std::move(buffer));
+    }
+}
+
+/**
+ * @brief Account for bytes more being kept, fails when that would exceed
+ * the budget
+ */
+inline bool buffer_pool::retain(std::size_t bytes) {
+    std::size_t retained = retained_bytes_.load(std::memory_order_relaxed);
+    do {
+        if (retained + bytes > max_retained_bytes_) {
+            return false;
+        }
+    } while (!retained_bytes_.compare_exchange_weak(
+        retained, retained + bytes, std::memory_order_relaxed));
+    return true;
+}
+
+} // namespace wired
+
+#endif // WIRED_BUFFER_POOL_H
@@ -6,10 +6,13 @@
 
 #include "wired/connection.h"
 #include "wired/message.h"
+#include "wired/mpsc_queue.h"
+#include "wired/tls_session.h"
 #include "wired/ts_deque.h"
 #include "wired/types.h"
 
 #include <deque>
+#include <optional>
 #include <iostream>
 #include <memory>
 
@@ -20,10 +23,29 @@ class client_interface {
     using message_t = message<T>;
     using connection_t = connection<T>;
     using connection_ptr = std::shared_ptr<connection_t>;
+    using send_callback = typename connection_t::send_callback;
+    using stream_source = typename connection_t::stream_source;
 
   public:
     virtual void on_message(message_t& msg, connection_ptr conn) = 0;
 
+    /**
+     * @brief Receive one chunk of a streamed payload
+     * Chunks of a stream arrive in order, msg.head().stream() tells the
+     * streams apart and msg.head().final_chunk() marks the last one.
+     * Defaults to on_message.
+     */
+    virtual void on_chunk(message_t& msg, connection_ptr conn) {
+        on_message(msg, conn);
+    }
+
+    /**
+     * @brief The outgoing queue drained to its low watermark after having
+     * reached the high one
+     * Runs on the connection's strand, keep it short.
+     */
+    virtual void on_writable([[maybe_unused]] connection_ptr conn) {}
+
   public:
     client_interface();
     client_interface(const client_interface& other) = delete;
@@ -34,43 +56,74 @@ class client_interface {
     client_interface& operator=(client_interface&& other);
 
     bool is_connected() const;
+    // Whether sends are below the high watermark of the outgoing queue
+    bool writable() const;
 
     void set_tls_options(const tls_options& options) { options_ = options; }
+    void set_connection_options(const connection_options& options) {
+        connection_options_ = options;
+    }
+    // Shorthand for the compression of connection_options
+    void set_compression_options(const compression_options& options) {
+        connection_options_.set_compression(options);
+    }
+    // Full and resumed handshakes of tls connections made by this client
+    const tls_handshake_stats& handshake_stats() const {
+        return session_cache_.stats();
+    }
+    tls_session_cache& session_cache() { return session_cache_; }
 
     // std::future<bool> ping();
 
     std::future<bool> connect(const std::string& host, const std::string& port);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    std::future<bool>
+    connect_local(const asio::local::stream_protocol::endpoint& endpoint);
+#endif
     std::future<bool> disconnect();
     std::future<bool>
     send(const message_t& msg,
          message_strategy strategy = message_strategy::normal);
+    void send(const message_t& msg, send_callback callback,
+              message_strategy strategy = message_strategy::normal);
+    void post(const message_t& msg,
+              message_strategy strategy = message_strategy::normal);
+    std::future<bool>
+    send_stream(T id, stream_source source, std::size_t chunk_size = 64 * 1024,
+                message_strategy strategy = message_strategy::normal);
+    bool send_unreliable(const message_t& msg);
+    // Write the messages held back by coalescing, see coalesce_options
+    void flush();
 
     void run(execution_policy policy = execution_policy::blocking);
 
   private:
     void messaging_loop();
     void contribute_to_context_pool();
+    void watch_drain();
 
   private:
     asio::io_context context_;
-    asio::ssl::context ssl_context_;
+    // Only created for a tls transport
+    std::optional<asio::ssl::context> ssl_context_;
+    // Sessions for resuming, destroyed after connection_
+    tls_session_cache session_cache_;
     asio::executor_work_guard<asio::io_context::executor_type> idle_work_;
     std::thread asio_thread_;
     connection_ptr connection_;
-    ts_deque<message_t> messages_;
+    mpsc_queue<message_t> messages_;
     std::thread messages_thread_;
-    std::condition_variable cv_;
-    std::mutex mutex_;
     std::atomic<bool> stop_messaging_loop_;
     tls_options options_;
+    connection_options connection_options_;
 }; // class client_interface
 
 template <typename T>
 client_interface<T>::client_interface()
-    : context_(), ssl_context_(asio::ssl::context::tls_client),
+    : context_(), ssl_context_(), session_cache_(),
       idle_work_(asio::make_work_guard(context_)), asio_thread_(),
-      connection_(nullptr), messages_(), messages_thread_(), cv_(), mutex_(),
-      stop_messaging_loop_(false), options_() {
+      connection_(nullptr), messages_(), messages_thread_(),
+      stop_messaging_loop_(false), options_(), connection_options_() {
     WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                       "client_interface object [{}] called default constructor",
                       static_cast<void*>(this));
@@ -84,8 +137,7 @@ client_interface<T>::client_interface(client_interface&& other)
       idle_work_(std::move(other.idle_work_)),
       asio_thread_(std::move(other.asio_thread_)),
       connection_(std::move(other.connection_)),
-      messages_(std::move(other.messages_)), messages_thread_(),
-      cv_(std::move(other.cv_)), mutex_(std::move(other.mutex_)) {
+      messages_(), messages_thread_() {
     WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                       "client_interface object [{}] called move constructor",
                       static_cast<void*>(this));
@@ -102,7 +154,7 @@ client_interface<T>::~client_interface() {
     }
 
     stop_messaging_loop_ = true;
-    cv_.notify_all();
+    messages_.wake();
     if (messages_thread_.joinable()) {
         messages_thread_.join();
     }
@@ -118,10 +170,7 @@ client_interface<T>& client_interface<T>::operator=(client_interface&& other) {
     idle_work_ = std::move(other.idle_work_);
     asio_thread_ = std::move(other.asio_thread_);
     connection_ = std::move(other.connection_);
-    messages_ = std::move(other.messages_);
     messages_thread_ = std::move(other.messages_thread_);
-    cv_ = std::move(other.cv_);
-    mutex_ = std::move(other.mutex_);
 
     other.connection_ = nullptr;
     other.messages_.clear();
@@ -137,6 +186,24 @@ bool client_interface<T>::is_connected() const {
     return connection_->is_connected();
 }
 
+template <typename T>
+bool client_interface<T>::writable() const {
+    return connection_ && connection_->writable();
+}
+
+/**
+ * @brief Forward the drain notifications of connection_ to on_writable
+ */
+template <typename T>
+void client_interface<T>::watch_drain() {
+    std::weak_ptr<connection_t> weak = connection_;
+    connection_->set_drain_handler([this, weak]() {
+        if (auto conn = weak.lock()) {
+            on_writable(conn);
+        }
+    });
+}
+
 template <typename T>
 std::future<bool> client_interface<T>::connect(const std::string& host,
                                                const std::string& port) {
@@ -145,19 +212,32 @@ std::future<bool> client_interface<T>::connect(const std::string& host,
                           "Client tried to connect while already connected");
         disconnect();
     }
-    tls_options::set_context_options(ssl_context_, options_);
+    const connection_options& options = connection_options_;
+    if (options.transport() == transport::tls) {
+        if (!ssl_context_) {
+            ssl_context_.emplace(asio::ssl::context::tls_client);
+        }
+        tls_options::set_context_options(*ssl_context_, options_);
+        session_cache_.attach(*ssl_context_, options_.session_cache_size());
+    }
     try {
         asio::ip::tcp::resolver resolver(context_);
 
         asio::ip::tcp::resolver::results_type endpoints =
             resolver.resolve(host, port);
 
-        connection_ = std::make_shared<connection_t>(
-            context_, ssl_context_, asio::ip::tcp::socket(context_), messages_,
-            cv_);
+        if (options.transport() == transport::tls) {
+            connection_ = std::make_shared<connection_t>(
+                context_, *ssl_context_, asio::ip::tcp::socket(context_),
+                messages_, options);
+        } else {
+            connection_ = std::make_shared<connection_t>(
+                context_, asio::ip::tcp::socket(context_), messages_, options);
+        }
 
         WIRED_LOG_MESSAGE(log_level::LOG_DEBUG, "connection object address: {}",
                           static_cast<void*>(connection_.get()));
+        watch_drain();
 
         std::future<bool> connection_result = connection_->connect(endpoints);
         return connection_result;
@@ -168,6 +248,30 @@ std::future<bool> client_interface<T>::connect(const std::string& host,
     }
 }
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+/**
+ * @brief Connect to a server listening on a unix domain socket
+ * Local connections are plaintext, the shm transport carries the messages
+ * through shared memory rings set up over the socket
+ */
+template <typename T>
+std::future<bool> client_interface<T>::connect_local(
+    const asio::local::stream_protocol::endpoint& endpoint) {
+    if (is_connected()) {
+        WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                          "Client tried to connect while already connected");
+        disconnect();
+    }
+    connection_ = std::make_shared<connection_t>(
+        context_, asio::local::stream_protocol::socket(context_), messages_,
+        connection_options_);
+    WIRED_LOG_MESSAGE(log_level::LOG_DEBUG, "connection object address: {}",
+                      static_cast<void*>(connection_.get()));
+    watch_drain();
+    return connection_->connect(endpoint);
+}
+#endif
+
 template <typename T>
 std::future<bool> client_interface<T>::disconnect() {
     if (!is_connected()) {
@@ -191,6 +295,57 @@ std::future<bool> client_interface<T>::send(const message_t& msg,
     return connection_result;
 }
 
+template <typename T>
+void client_interface<T>::send(const message_t& msg, send_callback callback,
+                               message_strategy strategy) {
+    if (!is_connected()) {
+        if (callback) {
+            callback(false);
+        }
+        return;
+    }
+    connection_->send(msg, strategy, std::move(callback));
+}
+
+template <typename T>
+void client_interface<T>::post(const message_t& msg,
+                               message_strategy strategy) {
+    if (!is_connected()) {
+        return;
+    }
+    connection_->post(msg, strategy);
+}
+
+template <typename T>
+void client_interface<T>::flush() {
+    if (!is_connected()) {
+        return;
+    }
+    connection_->flush();
+}
+
+template <typename T>
+std::future<bool> client_interface<T>::send_stream(T id, stream_source source,
+                                                   std::size_t chunk_size,
+                                                   message_strategy strategy) {
+    if (!is_connected()) {
+        std::promise<bool> promise;
+        promise.set_value(false);
+        return promise.get_future();
+    }
+    return connection_->send_stream(id, std::move(source), chunk_size,
+                                    strategy);
+}
+
+/**
+ * @brief Send a message over the datagram channel, see
+ * connection::send_unreliable
+ */
+template <typename T>
+bool client_interface<T>::send_unreliable(const message_t& msg) {
+    return is_connected() && connection_->send_unreliable(msg);
+}
+
 template <typename T>
 void client_interface<T>::run(execution_policy policy) {
     stop_messaging_loop_ = false;
@@ -214,13 +369,13 @@ void client_interface<T>::run(execution_policy policy) {
 
 template <typename T>
 void client_interface<T>::messaging_loop() {
+    constexpr std::size_t batch_size = 64;
+    std::vector<message_t> batch;
+    batch.reserve(batch_size);
     while (is_connected()) {
-        std::unique_lock<std::mutex> lock(mutex_);
         WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                           "Waiting for messages in the queue");
-        cv_.wait(lock, [this] {
-            return (!messages_.empty() || stop_messaging_loop_);
-        });
+        messages_.wait();
         if (stop_messaging_loop_) {
             WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                               "Stop messaging loop, exiting");
@@ -229,18 +384,28 @@ void client_interface<T>::messaging_loop() {
         WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                           "Messages in the queue, processing them");
 
-        while (!messages_.empty()) {
-            if (stop_messaging_loop_) {
+        while (messages_.try_pop_n(std::back_inserter(batch), batch_size) >
+               0) {
+            if (connection_ptr conn = connection_) {
+                // Reading paused while the queue was full
+                conn->resume_reading();
+            }
+            for (auto& msg : batch) {
+                if (stop_messaging_loop_) {
+                    WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                                      "Stop messaging loop, exiting");
+                    return;
+                }
                 WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
-                                  "Stop messaging loop, exiting");
-                return;
+                                  "Processing message with id {}",
+                                  static_cast<uint32_t>(msg.head().id()));
+                if (msg.head().is_chunk()) {
+                    on_chunk(msg, msg.from());
+                } else {
+                    on_message(msg, msg.from());
+                }
             }
-            message_t msg = messages_.front();
-            messages_.pop_front();
-            WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
-                              "Processing message with id {}",
-                              static_cast<uint32_t>(msg.head().id()));
-            on_message(msg, msg.from());
+            batch.clear();
         }
     }
 }
@@ -0,0 +1,267 @@
+#ifndef WIRED_COMPRESSION_H
+#define WIRED_COMPRESSION_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace wired {
+
+/**
+ * @brief LZ4 block format codec
+ * Greedy single pass compressor with a 4096 entry hash table, output is a
+ * plain LZ4 block that any LZ4 decoder accepts. The decompressor checks
+ * every length and offset against both buffers, so a corrupt or malicious
+ * block fails instead of reading or writing out of bounds.
+ */
+class lz4_codec {
+  public:
+    static std::size_t max_compressed_size(std::size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    static std::size_t compress(const uint8_t* src, std::size_t size,
+                                uint8_t* dst);
+    static bool decompress(const uint8_t* src, std::size_t size, uint8_t* dst,
+                           std::size_t original_size);
+
+  private:
+    static constexpr std::size_t min_match_ = 4;
+    // Matches may not start in the last 12 bytes nor cover the last 5
+    static constexpr std::size_t match_limit_ = 12;
+    static constexpr std::size_t last_literals_ = 5;
+    static constexpr std::size_t max_offset_ = 65535;
+    static constexpr unsigned hash_bits_ = 12;
+
+    static uint32_t read32(const uint8_t* p) {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    static uint32_t hash(uint32_t sequence) {
+        return (sequence * 2654435761u) >> (32 - hash_bits_);
+    }
+
+    static uint8_t* put_length(uint8_t* out, std::size_t length) {
+        while (length >= 255) {
+            *out++ = 255;
+            length -= 255;
+        }
+        *out++ = static_cast<uint8_t>(length);
+        return out;
+    }
+
+    static uint8_t* put_sequence(uint8_t* out, const uint8_t* literals,
+                                 std::size_t literal_length,
+                                 std::size_t offset,
+                                 std::size_t match_length);
+}; // class lz4_codec
+
+/**
+ * @brief Compress src into dst, which must hold max_compressed_size(size)
+ *
+ * @return size of the compressed block
+ */
+inline std::size_t lz4_codec::compress(const uint8_t* src, std::size_t size,
+                                       uint8_t* dst) {
+    uint8_t* out = dst;
+    std::size_t anchor = 0;
+    if (size > match_limit_) {
+        std::array<uint32_t, std::size_t(1) << hash_bits_> table{};
+        std::size_t limit = size - match_limit_;
+        std::size_t ip = 0;
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t& slot = table[hash(sequence)];
+            std::size_t candidate = slot;
+            slot = static_cast<uint32_t>(ip);
+            if (candidate >= ip || ip - candidate > max_offset_ ||
+                read32(src + candidate) != sequence) {
+                ++ip;
+                continue;
+            }
+
+            std::size_t length = min_match_;
+            while (ip + length < size - last_literals_ &&
+                   src[candidate + length] == src[ip + length]) {
+                ++length;
+            }
+            out = put_sequence(out, src + anchor, ip - anchor,
+                               ip - candidate, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+    return static_cast<std::size_t>(
+        put_sequence(out, src + anchor, size - anchor, 0, 0) - dst);
+}
+
+/**
+ * @brief Decompress a block that must expand to exactly original_size bytes
+ */
+inline bool lz4_codec::decompress(const uint8_t* src, std::size_t size,
+                                  uint8_t* dst, std::size_t original_size) {
+    std::size_t ip = 0;
+    std::size_t op = 0;
+    while (ip < size) {
+        uint8_t token = src[ip++];
+
+        std::size_t literal_length = token >> 4;
+        if (literal_length == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= size) {
+                    return false;
+                }
+                byte = src[ip++];
+                literal_length += byte;
+            } while (byte == 255);
+        }
+        if (literal_length > size - ip || literal_length > original_size - op) {
+            return false;
+        }
+        std::memcpy(dst + op, src + ip, literal_length);
+        ip += literal_length;
+        op += literal_length;
+        if (ip == size) {
+            break;
+        }
+
+        if (size - ip < 2) {
+            return false;
+        }
+        std::size_t offset = src[ip] | (static_cast<std::size_t>(src[ip + 1])
+                                        << 8);
+        ip += 2;
+        if (offset == 0 || offset > op) {
+            return false;
+        }
+        std::size_t match_length = token & 0x0f;
+        if (match_length == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= size) {
+                    return false;
+                }
+                byte = src[ip++];
+                match_length += byte;
+            } while (byte == 255);
+        }
+        match_length += min_match_;
+        if (match_length > original_size - op) {
+            return false;
+        }
+        if (offset >= match_length) {
+            std::memcpy(dst + op, dst + op - offset, match_length);
+        } else {
+            // Overlapping match repeats the last offset bytes
+            for (std::size_t i = 0; i < match_length; ++i) {
+                dst[op + i] = dst[op - offset + i];
+            }
+        }
+        op += match_length;
+    }
+    return op == original_size;
+}
+
+/**
+ * @brief Write one sequence, a match length of 0 writes the final literals
+ */
+inline uint8_t* lz4_codec::put_sequence(uint8_t* out, const uint8_t* literals,
+                                        std::size_t literal_length,
+                                        std::size_t offset,
+                                        std::size_t match_length) {
+    uint8_t* token = out++;
+    *token = static_cast<uint8_t>((literal_length < 15 ? literal_length : 15)
+                                  << 4);
+    if (literal_length >= 15) {
+        out = put_length(out, literal_length - 15);
+    }
+    std::memcpy(out, literals, literal_length);
+    out += literal_length;
+    if (match_length == 0) {
+        return out;
+    }
+
+    *out++ = static_cast<uint8_t>(offset);
+    *out++ = static_cast<uint8_t>(offset >> 8);
+    std::size_t length = match_length - min_match_;
+    *token |= static_cast<uint8_t>(length < 15 ? length : 15);
+    if (length >= 15) {
+        out = put_length(out, length - 15);
+    }
+    return out;
+}
+
+/**
+ * @brief Counters of the work done by body compression
+ * Every attempt counts towards the time and input bytes, only bodies that
+ * got smaller and were sent compressed count as compressed messages.
+ * Updated with relaxed atomics, readers get a consistent value per counter
+ * but not across counters.
+ */
+class compression_stats {
+  public:
+    compression_stats()
+        : attempts_(0), attempted_bytes_(0), compressed_messages_(0),
+          bytes_saved_(0), compress_ns_(0), decompressed_messages_(0),
+          decompress_ns_(0) {}
+
+    void record_compression(std::size_t bytes_in, std::size_t bytes_out,
+                            std::chrono::nanoseconds elapsed) {
+        attempts_.fetch_add(1, std::memory_order_relaxed);
+        attempted_bytes_.fetch_add(bytes_in, std::memory_order_relaxed);
+        compress_ns_.fetch_add(elapsed.count(), std::memory_order_relaxed);
+        if (bytes_out < bytes_in) {
+            compressed_messages_.fetch_add(1, std::memory_order_relaxed);
+            bytes_saved_.fetch_add(bytes_in - bytes_out,
+                                   std::memory_order_relaxed);
+        }
+    }
+
+    void record_decompression(std::chrono::nanoseconds elapsed) {
+        decompressed_messages_.fetch_add(1, std::memory_order_relaxed);
+        decompress_ns_.fetch_add(elapsed.count(), std::memory_order_relaxed);
+    }
+
+    uint64_t compression_attempts() const {
+        return attempts_.load(std::memory_order_relaxed);
+    }
+    uint64_t attempted_bytes() const {
+        return attempted_bytes_.load(std::memory_order_relaxed);
+    }
+    uint64_t compressed_messages() const {
+        return compressed_messages_.load(std::memory_order_relaxed);
+    }
+    uint64_t bytes_saved() const {
+        return bytes_saved_.load(std::memory_order_relaxed);
+    }
+    std::chrono::nanoseconds compress_time() const {
+        return std::chrono::nanoseconds(
+            compress_ns_.load(std::memory_order_relaxed));
+    }
+    uint64_t decompressed_messages() const {
+        return decompressed_messages_.load(std::memory_order_relaxed);
+    }
+    std::chrono::nanoseconds decompress_time() const {
+        return std::chrono::nanoseconds(
+            decompress_ns_.load(std::memory_order_relaxed));
+    }
+
+  private:
+    std::atomic<uint64_t> attempts_;
+    std::atomic<uint64_t> attempted_bytes_;
+    std::atomic<uint64_t> compressed_messages_;
+    std::atomic<uint64_t> bytes_saved_;
+    std::atomic<int64_t> compress_ns_;
+    std::atomic<uint64_t> decompressed_messages_;
+    std::atomic<int64_t> decompress_ns_;
+}; // class compression_stats
+
+} // namespace wired
+
+#endif // WIRED_COMPRESSION_H
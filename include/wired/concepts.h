@@ -3,6 +3,8 @@
 
 #include <concepts>
 #include <cstdint>
+#include <tuple>
+#include <type_traits>
 #include <vector>
 
 namespace wired {
@@ -17,6 +19,11 @@ concept has_wired_deserializable = requires(T t, std::vector<uint8_t>&& data) {
     { t.wired_deserialize(std::move(data)) } -> std::same_as<void>;
 };
 
+template <typename T>
+concept has_wired_schema = requires {
+    std::tuple_size<std::remove_cvref_t<decltype(T::wired_fields)>>::value;
+};
+
 template <typename T>
 concept is_wired_serializable =
     has_wired_serializable<T> && has_wired_deserializable<T>;
@@ -1,19 +1,31 @@
 #ifndef WIRED_CONNECTION_H
 #define WIRED_CONNECTION_H
 
+#include "wired/buffer_pool.h"
+#include "wired/compression.h"
+#include "wired/datagram.h"
 #include "wired/message.h"
+#include "wired/mpsc_queue.h"
+#include "wired/send_scheduler.h"
+#include "wired/tls_session.h"
 #include "wired/tools/log.h"
-#include "wired/ts_deque.h"
+#include "wired/transport.h"
 #include "wired/types.h"
 
 #include <asio.hpp>
 #include <asio/ssl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
 #include <functional>
 #include <future>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <type_traits>
 #include <utility>
+#include <variant>
 
 namespace wired {
 
@@ -21,12 +33,38 @@ template <typename T>
 class connection : public std::enable_shared_from_this<connection<T>> {
   public:
     using message_t = message<T>;
+    using strand_t = asio::strand<asio::io_context::executor_type>;
+    using send_callback = std::function<void(bool)>;
+    using drain_handler = std::function<void()>;
+    using inbox_handler = std::function<void()>;
+    using frame_ptr = std::shared_ptr<const std::vector<uint8_t>>;
+    using stream_source =
+        std::function<std::size_t(uint8_t* buffer, std::size_t capacity)>;
 
   public:
     connection(asio::io_context& io_context, asio::ssl::context& ssl_context,
                asio::ip::tcp::socket&& socket,
-               ts_deque<message_t>& incoming_messages,
-               std::condition_variable& cv);
+               mpsc_queue<message_t>& incoming_messages,
+               const connection_options& options = connection_options());
+    connection(asio::io_context& io_context, asio::ip::tcp::socket&& socket,
+               mpsc_queue<message_t>& incoming_messages,
+               const connection_options& options = connection_options());
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    connection(asio::io_context& io_context,
+               asio::local::stream_protocol::socket&& socket,
+               mpsc_queue<message_t>& incoming_messages,
+               const connection_options& options = connection_options());
+#endif
+    connection(asio::io_context& io_context, asio::ssl::context& ssl_context,
+               asio::ip::tcp::socket&& socket,
+               const connection_options& options = connection_options());
+    connection(asio::io_context& io_context, asio::ip::tcp::socket&& socket,
+               const connection_options& options = connection_options());
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    connection(asio::io_context& io_context,
+               asio::local::stream_protocol::socket&& socket,
+               const connection_options& options = connection_options());
+#endif
     connection(const connection& other) = delete;
     connection(connection&& other) noexcept;
     ~connection();
@@ -34,43 +72,153 @@ class connection : public std::enable_shared_from_this<connection<T>> {
     connection& operator=(const connection&& other) = delete;
     connection& operator=(connection&& other) noexcept;
 
-    // asio::ip::tcp::socket& socket();
-    // const asio::ip::tcp::socket& socket() const;
-    asio::ssl::stream<asio::ip::tcp::socket>& ssl_stream();
-    const asio::ssl::stream<asio::ip::tcp::socket>& ssl_stream() const;
+    transport_stream& stream() { return stream_; }
+    const transport_stream& stream() const { return stream_; }
+    transport_stream::tls_stream_t& ssl_stream();
+    const transport_stream::tls_stream_t& ssl_stream() const;
+    strand_t& strand() { return strand_; }
+
+    static frame_ptr
+    make_frame(const message_t& msg,
+               const compression_options& compression = compression_options(),
+               wired::compression_stats* stats = nullptr);
 
     bool is_connected() const;
     std::future<bool> send(const message_t& msg, message_strategy strategy);
+    void send(const message_t& msg, message_strategy strategy,
+              send_callback callback);
+    void post(const message_t& msg, message_strategy strategy);
+    std::future<bool> send(frame_ptr frame, message_strategy strategy);
+    void send(frame_ptr frame, message_strategy strategy,
+              send_callback callback);
+    void post(frame_ptr frame, message_strategy strategy);
+    std::future<bool> send_stream(T id, stream_source source,
+                                  std::size_t chunk_size,
+                                  message_strategy strategy);
+    uint64_t open_stream() { return next_stream_.fetch_add(1); }
+    bool send_unreliable(const message_t& msg);
+    bool enable_datagrams(std::shared_ptr<datagram_socket> socket,
+                          handshake_role role,
+                          const asio::ip::udp::endpoint& peer = {});
+    void receive_datagram(std::vector<uint8_t>&& packet,
+                          const asio::ip::udp::endpoint& from);
+    uint64_t datagram_channel() const { return datagram_session_.channel(); }
     std::future<bool> connect(asio::ip::tcp::resolver::results_type& endpoints);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    std::future<bool>
+    connect(const asio::local::stream_protocol::endpoint& endpoint);
+#endif
 
     std::future<bool> disconnect();
     std::size_t incoming_messages_count() const;
     std::size_t outgoing_messages_count() const;
-    ts_deque<message_t>& incoming_messages();
-    const ts_deque<message_t>& incoming_messages() const;
+    // Whether the outgoing queue is below its high watermark, see
+    // send_queue_options
+    bool writable() const { return writable_.load(std::memory_order_acquire); }
+    std::size_t queued_bytes() const {
+        return queued_bytes_.load(std::memory_order_relaxed);
+    }
+    std::size_t queued_messages() const {
+        return queued_messages_.load(std::memory_order_relaxed);
+    }
+    // Messages discarded by the overflow policy
+    uint64_t dropped_messages() const {
+        return dropped_messages_.load(std::memory_order_relaxed);
+    }
+    // Depth and sent messages of every priority level
+    const send_scheduler_stats& send_stats() const {
+        return outgoing_messages_.stats();
+    }
+    void set_drain_handler(drain_handler handler);
+    void flush();
+    const std::shared_ptr<buffer_pool>& body_pool() const {
+        return body_pool_;
+    }
+    const wired::compression_stats& compression_stats() const {
+        return compression_stats_;
+    }
+    mpsc_queue<message_t>& incoming_messages();
+    const mpsc_queue<message_t>& incoming_messages() const;
+    void set_inbox_handler(inbox_handler handler);
+    template <typename Container>
+    bool take_turn(Container& batch, std::size_t quota);
+    bool reading_paused() const {
+        return reading_paused_.load(std::memory_order_acquire);
+    }
+    void resume_reading();
 
     void start_listening() {
         WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
                           "Connection object [{}] started listening",
                           static_cast<void*>(this));
-        read_header();
+        asio::dispatch(strand_, [this]() { read_messages(); });
     }
 
   private:
-    void read_header();
-    void read_header_handler(const asio::error_code& error,
-                             std::size_t bytes_transferred);
-    void read_body();
+    // A serialized message and whatever has to be told once it is written,
+    // post leaves the completion empty so no shared state is allocated
+    struct outgoing_message {
+        frame_ptr frame;
+        std::variant<std::monostate, std::promise<bool>, send_callback>
+            completion;
+    };
+
+    // A payload being sent chunk by chunk, alive until its last chunk is
+    // written
+    struct outgoing_stream {
+        T id;
+        uint64_t stream;
+        stream_source source;
+        std::size_t chunk_size;
+        message_strategy strategy;
+        std::promise<bool> promise;
+    };
+
+    connection(asio::io_context& io_context, transport_stream&& stream,
+               mpsc_queue<message_t>* incoming_messages,
+               const connection_options& options);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    static transport_stream
+    make_local_stream(asio::local::stream_protocol::socket&& socket,
+                      const connection_options& options);
+#endif
+
+    frame_ptr build_frame(const message_t& msg) {
+        return make_frame(msg, options_.compression(), &compression_stats_);
+    }
+    void handshake(std::promise<bool>&& promise);
+    void open_client_datagrams();
+    void deliver_datagram(const std::vector<uint8_t>& payload);
+    void enqueue(outgoing_message&& entry, message_strategy strategy);
+    bool admit(outgoing_message& entry);
+    bool hold_back(message_strategy strategy) const;
+    void arm_flush_timer();
+    void release(std::size_t bytes, std::size_t messages);
+    std::size_t drop_queued();
+    void send_next_chunk(std::shared_ptr<outgoing_stream> state);
+    static void complete(outgoing_message& entry,
+                         std::exception_ptr error = nullptr);
+    static void discard(outgoing_message& entry);
+
+    void read_messages();
+    void read_messages_handler(const asio::error_code& error,
+                               std::size_t bytes_transferred);
+    void parse_messages();
+    void read_body(std::size_t offset);
     void read_body_handler(const asio::error_code& error,
                            std::size_t bytes_transferred);
-    void write_header();
-    void write_header_handler(const asio::error_code& error,
-                              std::size_t bytes_transferred);
-    void write_body();
-    void write_body_handler(const asio::error_code& error,
-                            std::size_t bytes_transferred);
+    void write_messages();
+    void write_messages_handler(const asio::error_code& error,
+                                std::size_t bytes_transferred);
 
-    void append_finished_message();
+    message_body<T> acquire_body(std::size_t size);
+    bool decompress_body();
+    bool append_finished_message();
+    void push_incoming(message_t&& msg);
+    bool pause_reading();
+    void apply_socket_options();
+    template <typename Socket>
+    void apply_socket_options(Socket& socket);
 
     bool is_disconnect_error(const asio::error_code& error) {
         return error == asio::error::eof ||
@@ -81,35 +229,196 @@ class connection : public std::enable_shared_from_this<connection<T>> {
 
   private:
     asio::io_context& io_context_;
-    asio::ssl::context& ssl_context_;
-    asio::ssl::stream<asio::ip::tcp::socket> ssl_stream_;
-    ts_deque<std::pair<message_t, std::promise<bool>>> outgoing_messages_;
-    ts_deque<message_t>& incoming_messages_;
+    strand_t strand_;
+    transport_stream stream_;
+    connection_options options_;
+    send_scheduler<outgoing_message> outgoing_messages_;
+    std::vector<outgoing_message> writing_messages_;
+    // Bytes and messages of both outgoing_messages_ and writing_messages_,
+    // only changed on the strand
+    std::atomic<std::size_t> queued_bytes_;
+    std::atomic<std::size_t> queued_messages_;
+    std::atomic<bool> writable_;
+    std::atomic<uint64_t> dropped_messages_;
+    drain_handler drain_handler_;
+    asio::steady_timer flush_timer_; // Deadline of held back messages
+    bool flush_armed_;
+    std::vector<asio::const_buffer> write_buffers_;
+    std::vector<uint8_t> write_buffer_;
+    // Only allocated when no queue is given, declared before the pointer
+    std::unique_ptr<mpsc_queue<message_t>> inbox_;
+    mpsc_queue<message_t>* incoming_messages_;
+    inbox_handler inbox_handler_;
+    std::atomic<bool> scheduled_; // inbox_handler_ called, turn not taken
+    std::atomic<bool> reading_paused_;
+    std::vector<uint8_t> read_buffer_;
+    std::size_t read_begin_;
+    std::size_t read_end_;
+    std::shared_ptr<buffer_pool> body_pool_;
     message_t aux_message_;
-    std::condition_variable& cv_;
+    std::atomic<uint64_t> next_stream_;
+    wired::compression_stats compression_stats_;
+    std::shared_ptr<datagram_socket> datagram_socket_;
+    bool owns_datagram_socket_; // Client side, closed on disconnect
+    asio::ip::udp::endpoint datagram_peer_;
+    datagram_session datagram_session_;
+    std::vector<uint8_t> datagram_payload_;
 };
 
+/**
+ * @brief Connection over the transport selected by options, ssl_context is
+ * not used by a tcp transport
+ */
 template <typename T>
 connection<T>::connection(asio::io_context& io_context,
                           asio::ssl::context& ssl_context,
                           asio::ip::tcp::socket&& socket,
-                          ts_deque<message_t>& incoming_messages,
-                          std::condition_variable& cv)
-    : io_context_(io_context), ssl_context_(ssl_context),
-      ssl_stream_(std::move(socket), ssl_context_), outgoing_messages_(),
-      incoming_messages_(incoming_messages), aux_message_(), cv_(cv) {
+                          mpsc_queue<message_t>& incoming_messages,
+                          const connection_options& options)
+    : connection(io_context,
+                 options.transport() == transport::tls
+                     ? transport_stream(std::move(socket), ssl_context)
+                     : transport_stream(std::move(socket)),
+                 &incoming_messages, options) {}
+
+/**
+ * @brief Plaintext connection, the transport in options is ignored
+ */
+template <typename T>
+connection<T>::connection(asio::io_context& io_context,
+                          asio::ip::tcp::socket&& socket,
+                          mpsc_queue<message_t>& incoming_messages,
+                          const connection_options& options)
+    : connection(io_context, transport_stream(std::move(socket)),
+                 &incoming_messages, options) {}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+/**
+ * @brief Plaintext connection over a unix domain socket, carried by shm
+ * rings when options select the shm transport
+ */
+template <typename T>
+connection<T>::connection(asio::io_context& io_context,
+                          asio::local::stream_protocol::socket&& socket,
+                          mpsc_queue<message_t>& incoming_messages,
+                          const connection_options& options)
+    : connection(io_context, make_local_stream(std::move(socket), options),
+                 &incoming_messages, options) {}
+
+template <typename T>
+transport_stream
+connection<T>::make_local_stream(asio::local::stream_protocol::socket&& socket,
+                                 const connection_options& options) {
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+    if (options.transport() == transport::shm) {
+        return transport_stream(shm_stream(std::move(socket),
+                                           options.shm_ring_size(),
+                                           options.shm_busy_poll()));
+    }
+#endif
+    return transport_stream(std::move(socket));
+}
+#endif
+
+/**
+ * @brief Connections without a queue deliver into an inbox of their own,
+ * see set_inbox_handler
+ */
+template <typename T>
+connection<T>::connection(asio::io_context& io_context,
+                          asio::ssl::context& ssl_context,
+                          asio::ip::tcp::socket&& socket,
+                          const connection_options& options)
+    : connection(io_context,
+                 options.transport() == transport::tls
+                     ? transport_stream(std::move(socket), ssl_context)
+                     : transport_stream(std::move(socket)),
+                 nullptr, options) {}
+
+template <typename T>
+connection<T>::connection(asio::io_context& io_context,
+                          asio::ip::tcp::socket&& socket,
+                          const connection_options& options)
+    : connection(io_context, transport_stream(std::move(socket)), nullptr,
+                 options) {}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+template <typename T>
+connection<T>::connection(asio::io_context& io_context,
+                          asio::local::stream_protocol::socket&& socket,
+                          const connection_options& options)
+    : connection(io_context, make_local_stream(std::move(socket), options),
+                 nullptr, options) {}
+#endif
+
+template <typename T>
+connection<T>::connection(asio::io_context& io_context,
+                          transport_stream&& stream,
+                          mpsc_queue<message_t>* incoming_messages,
+                          const connection_options& options)
+    : io_context_(io_context), strand_(asio::make_strand(io_context)),
+      stream_(std::move(stream)), options_(options),
+      outgoing_messages_(options_.send_scheduler()), writing_messages_(),
+      queued_bytes_(0),
+      queued_messages_(0), writable_(true), dropped_messages_(0),
+      drain_handler_(), flush_timer_(io_context), flush_armed_(false),
+      write_buffers_(), write_buffer_(),
+      inbox_(incoming_messages ? nullptr
+                               : std::make_unique<mpsc_queue<message_t>>()),
+      incoming_messages_(incoming_messages ? incoming_messages : inbox_.get()),
+      inbox_handler_(), scheduled_(false), reading_paused_(false),
+      read_buffer_(options_.receive_buffer_size()), read_begin_(0),
+      read_end_(0),
+      body_pool_(options_.body_pool_buffers() > 0
+                     ? std::make_shared<buffer_pool>(
+                           options_.body_pool_buffers(),
+                           options_.body_pool_bytes())
+                     : nullptr),
+      aux_message_(), next_stream_(1), compression_stats_(),
+      datagram_socket_(nullptr), owns_datagram_socket_(false),
+      datagram_peer_(), datagram_session_(), datagram_payload_() {
     WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
                       "Connection object [{}] called constructor",
                       static_cast<void*>(this));
+    // Accepted sockets arrive connected, client sockets get their options
+    // once connect succeeds
+    if (stream_.is_open()) {
+        apply_socket_options();
+    }
 }
 
 template <typename T>
 connection<T>::connection(connection&& other) noexcept
     : io_context_(std::move(other.io_context_)),
-      ssl_stream_(std::move(other.ssl_stream_)),
+      strand_(std::move(other.strand_)),
+      stream_(std::move(other.stream_)),
+      options_(std::move(other.options_)),
       outgoing_messages_(std::move(other.outgoing_messages_)),
-      incoming_messages_(std::move(other.incoming_messages_)),
-      aux_message_(std::move(other.aux_message_)), cv_(other.cv_) {
+      writing_messages_(std::move(other.writing_messages_)),
+      queued_bytes_(other.queued_bytes_.load()),
+      queued_messages_(other.queued_messages_.load()),
+      writable_(other.writable_.load()),
+      dropped_messages_(other.dropped_messages_.load()),
+      drain_handler_(std::move(other.drain_handler_)),
+      flush_timer_(std::move(other.flush_timer_)),
+      flush_armed_(other.flush_armed_),
+      write_buffers_(std::move(other.write_buffers_)),
+      write_buffer_(std::move(other.write_buffer_)),
+      inbox_(std::move(other.inbox_)),
+      incoming_messages_(other.incoming_messages_),
+      inbox_handler_(std::move(other.inbox_handler_)),
+      scheduled_(other.scheduled_.load()),
+      reading_paused_(other.reading_paused_.load()),
+      read_buffer_(std::move(other.read_buffer_)),
+      read_begin_(other.read_begin_), read_end_(other.read_end_),
+      body_pool_(std::move(other.body_pool_)),
+      aux_message_(std::move(other.aux_message_)),
+      next_stream_(other.next_stream_.load()), compression_stats_(),
+      datagram_socket_(std::move(other.datagram_socket_)),
+      owns_datagram_socket_(other.owns_datagram_socket_),
+      datagram_peer_(std::move(other.datagram_peer_)),
+      datagram_session_(std::move(other.datagram_session_)),
+      datagram_payload_() {
     WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                       "Connection object [{}] called move constructor",
                       static_cast<void*>(this));
@@ -120,22 +429,27 @@ connection<T>::~connection() {
     WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
                       "Connection object [{}] called destructor",
                       static_cast<void*>(this));
+    if (owns_datagram_socket_) {
+        datagram_socket_->close();
+    }
 }
 
+/**
+ * @brief TLS layer of the connection, only valid on a tls transport
+ */
 template <typename T>
-asio::ssl::stream<asio::ip::tcp::socket>& connection<T>::ssl_stream() {
-    return ssl_stream_;
+transport_stream::tls_stream_t& connection<T>::ssl_stream() {
+    return stream_.tls();
 }
 
 template <typename T>
-const asio::ssl::stream<asio::ip::tcp::socket>&
-connection<T>::ssl_stream() const {
-    return ssl_stream_;
+const transport_stream::tls_stream_t& connection<T>::ssl_stream() const {
+    return stream_.tls();
 }
 
 template <typename T>
 bool connection<T>::is_connected() const {
-    return ssl_stream_.lowest_layer().is_open();
+    return stream_.is_open();
 }
 
 template <typename T>
@@ -147,22 +461,488 @@ std::future<bool> connection<T>::send(const message_t& msg,
         promise.set_value(false);
         return future;
     }
-    asio::post(io_context_, [this, msg = std::move(msg),
-                             promise = std::move(promise), strategy]() mutable {
-        bool writing = !outgoing_messages_.empty();
-        std::pair<message_t, std::promise<bool>> pack{std::move(msg),
-                                                      std::move(promise)};
-        outgoing_messages_.add_message(strategy, std::move(pack));
-        WIRED_LOG_MESSAGE(wired::LOG_DEBUG, "Message added to queue");
-        if (!writing) {
+    enqueue(outgoing_message{build_frame(msg), std::move(promise)}, strategy);
+    return future;
+}
+
+/**
+ * @brief Send a message and report the result through a callback
+ * Callbacks of messages written by the same batch are invoked back to back
+ * on the connection's strand once that write completes. When the connection
+ * is already closed the callback is invoked right away with false.
+ */
+template <typename T>
+void connection<T>::send(const message_t& msg, message_strategy strategy,
+                         send_callback callback) {
+    if (!is_connected()) {
+        if (callback) {
+            callback(false);
+        }
+        return;
+    }
+    enqueue(outgoing_message{build_frame(msg), std::move(callback)}, strategy);
+}
+
+/**
+ * @brief Send a message without any completion notification
+ */
+template <typename T>
+void connection<T>::post(const message_t& msg, message_strategy strategy) {
+    if (!is_connected()) {
+        return;
+    }
+    enqueue(outgoing_message{build_frame(msg), std::monostate{}}, strategy);
+}
+
+/**
+ * @brief Serialize a message into an immutable frame
+ * The frame can be handed to any number of connections, they only share a
+ * reference to it and it is freed once the last of them wrote it.
+ * Bodies of at least the compression threshold are LZ4 compressed when
+ * compression is enabled and the result is smaller than the body.
+ */
+template <typename T>
+typename connection<T>::frame_ptr
+connection<T>::make_frame(const message_t& msg,
+                          const compression_options& compression,
+                          wired::compression_stats* stats) {
+    std::size_t body_size = msg.head().size();
+    if (compression.enabled() && body_size >= compression.threshold()) {
+        auto start = std::chrono::steady_clock::now();
+        message_header<T> head = msg.head();
+        head.compressed(true);
+        // Room for the header of a payload as large as the body, only a
+        // smaller payload is sent compressed
+        head.sync(body_size);
+        std::size_t reserved = head.wire_size();
+        auto frame = std::make_shared<std::vector<uint8_t>>(
+            reserved + message_header<T>::max_varint_size +
+            lz4_codec::max_compressed_size(body_size));
+        uint8_t* payload = frame->data() + reserved;
+        uint8_t* out = message_header<T>::put_varint(payload, body_size);
+        out += lz4_codec::compress(msg.body().data().data(), body_size, out);
+        std::size_t payload_size = static_cast<std::size_t>(out - payload);
+        if (stats) {
+            stats->record_compression(body_size, payload_size,
+                                      std::chrono::steady_clock::now() -
+                                          start);
+        }
+
+        if (payload_size < body_size) {
+            head.sync(payload_size);
+            std::size_t header_size = head.wire_size();
+            if (header_size < reserved) {
+                // The size varint got shorter, close the gap
+                std::memmove(frame->data() + header_size, payload,
+                             payload_size);
+            }
+            head.encode(frame->data());
+            frame->resize(header_size + payload_size);
+            return frame;
+        }
+    }
+
+    std::size_t header_size = msg.head().wire_size();
+    auto frame =
+        std::make_shared<std::vector<uint8_t>>(header_size + body_size);
+    msg.head().encode(frame->data());
+    if (body_size > 0) {
+        std::memcpy(frame->data() + header_size, msg.body().data().data(),
+                    body_size);
+    }
+    return frame;
+}
+
+template <typename T>
+std::future<bool> connection<T>::send(frame_ptr frame,
+                                      message_strategy strategy) {
+    std::promise<bool> promise;
+    std::future<bool> future = promise.get_future();
+    if (!is_connected()) {
+        promise.set_value(false);
+        return future;
+    }
+    enqueue(outgoing_message{std::move(frame), std::move(promise)}, strategy);
+    return future;
+}
+
+template <typename T>
+void connection<T>::send(frame_ptr frame, message_strategy strategy,
+                         send_callback callback) {
+    if (!is_connected()) {
+        if (callback) {
+            callback(false);
+        }
+        return;
+    }
+    enqueue(outgoing_message{std::move(frame), std::move(callback)}, strategy);
+}
+
+template <typename T>
+void connection<T>::post(frame_ptr frame, message_strategy strategy) {
+    if (!is_connected()) {
+        return;
+    }
+    enqueue(outgoing_message{std::move(frame), std::monostate{}}, strategy);
+}
+
+/**
+ * @brief Send a message over the datagram channel
+ * The message may be lost, duplicated messages are dropped and a message
+ * arriving after a newer one is dropped too. Bodies are never compressed.
+ * A server can only reach a client once a datagram of that client arrived,
+ * the client announces itself when the channel opens.
+ *
+ * @return false when the connection has no datagram channel or the message
+ * does not fit in one datagram
+ */
+template <typename T>
+bool connection<T>::send_unreliable(const message_t& msg) {
+    if (!datagram_socket_ || !is_connected()) {
+        return false;
+    }
+    frame_ptr frame = make_frame(msg);
+    if (frame->size() > datagram_session::max_payload_size) {
+        WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                          "{} Message of {} bytes does not fit in a datagram",
+                          static_cast<void*>(this), frame->size());
+        return false;
+    }
+    asio::post(strand_, [this, self = this->shared_from_this(), frame]() {
+        if (datagram_peer_ == asio::ip::udp::endpoint()) {
+            return;
+        }
+        datagram_socket_->send(
+            std::make_shared<const std::vector<uint8_t>>(
+                datagram_session_.seal(frame->data(), frame->size())),
+            datagram_peer_);
+    });
+    return true;
+}
+
+/**
+ * @brief Attach the datagram channel once the TLS handshake completed
+ * Must run on the connection's strand before the connection is shared with
+ * other threads. peer is left empty by a server, it learns the address of
+ * the client from the client's datagrams.
+ */
+template <typename T>
+bool connection<T>::enable_datagrams(std::shared_ptr<datagram_socket> socket,
+                                     handshake_role role,
+                                     const asio::ip::udp::endpoint& peer) {
+    if (!stream_.secure() ||
+        !datagram_session_.init(stream_.tls().native_handle(), role)) {
+        WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                          "{} Could not derive the datagram channel keys",
+                          static_cast<void*>(this));
+        return false;
+    }
+    datagram_socket_ = std::move(socket);
+    datagram_peer_ = peer;
+    return true;
+}
+
+/**
+ * @brief Accept a datagram received for this connection
+ * Forged and stale datagrams are dropped silently
+ */
+template <typename T>
+void connection<T>::receive_datagram(std::vector<uint8_t>&& packet,
+                                     const asio::ip::udp::endpoint& from) {
+    asio::post(strand_, [this, self = this->shared_from_this(),
+                         packet = std::move(packet), from]() {
+        if (!datagram_session_.open(packet, datagram_payload_)) {
             WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
-                              "Starting sending messages procedure");
-            write_header();
+                              "{} Dropped a forged or stale datagram",
+                              static_cast<void*>(this));
+            return;
+        }
+        if (!owns_datagram_socket_) {
+            // The client may have moved to another address or port
+            datagram_peer_ = from;
+        }
+        if (!datagram_payload_.empty()) {
+            deliver_datagram(datagram_payload_);
         }
     });
+}
+
+/**
+ * @brief Send a payload that is produced while it is being written
+ * source fills at most capacity bytes and returns how many it wrote, a
+ * short count ends the stream. Every call produces one chunk message with
+ * the given id, the next chunk is only requested once the previous one has
+ * been written, so no more than one chunk is held in memory. source runs on
+ * the connection's strand.
+ *
+ * @return future set to true once the final chunk is written
+ */
+template <typename T>
+std::future<bool> connection<T>::send_stream(T id, stream_source source,
+                                             std::size_t chunk_size,
+                                             message_strategy strategy) {
+    auto state = std::make_shared<outgoing_stream>(
+        outgoing_stream{id, open_stream(), std::move(source),
+                        std::max<std::size_t>(chunk_size, 1), strategy,
+                        std::promise<bool>()});
+    std::future<bool> future = state->promise.get_future();
+    if (!is_connected()) {
+        state->promise.set_value(false);
+        return future;
+    }
+    asio::post(strand_, [this, self = this->shared_from_this(), state]() {
+        send_next_chunk(state);
+    });
     return future;
 }
 
+template <typename T>
+void connection<T>::send_next_chunk(std::shared_ptr<outgoing_stream> state) {
+    message_t chunk(state->id);
+    auto& data = chunk.body().data();
+    data.resize(state->chunk_size);
+    std::size_t bytes;
+    try {
+        bytes = std::min(state->source(data.data(), data.size()), data.size());
+    } catch (...) {
+        state->promise.set_exception(std::current_exception());
+        return;
+    }
+    data.resize(bytes);
+    bool final_chunk = bytes < state->chunk_size;
+    chunk.head().sync(bytes);
+    chunk.head().stream(state->stream, final_chunk);
+
+    send(chunk, state->strategy, [this, state, final_chunk](bool sent) {
+        if (!sent) {
+            state->promise.set_value(false);
+        } else if (final_chunk) {
+            state->promise.set_value(true);
+        } else {
+            send_next_chunk(state);
+        }
+    });
+}
+
+template <typename T>
+void connection<T>::enqueue(outgoing_message&& entry,
+                            message_strategy strategy) {
+    asio::post(strand_, [this, self = this->shared_from_this(),
+                         entry = std::move(entry), strategy]() mutable {
+        if (!is_connected()) {
+            discard(entry);
+            return;
+        }
+        if (!admit(entry)) {
+            return;
+        }
+        bool writing = !writing_messages_.empty();
+        std::size_t size = entry.frame->size();
+        outgoing_messages_.push(strategy, std::move(entry), size);
+        WIRED_LOG_MESSAGE(wired::LOG_DEBUG, "Message added to queue");
+        if (writing) {
+            return;
+        }
+        if (hold_back(strategy)) {
+            arm_flush_timer();
+            return;
+        }
+        WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                          "Starting sending messages procedure");
+        write_messages();
+    });
+}
+
+/**
+ * @brief Whether an idle connection waits for more messages before
+ * writing, see coalesce_options
+ */
+template <typename T>
+bool connection<T>::hold_back(message_strategy strategy) const {
+    const auto& coalescing = options_.coalescing();
+    return coalescing.enabled() && strategy != message_strategy::control &&
+           queued_bytes_.load(std::memory_order_relaxed) <
+               coalescing.flush_bytes();
+}
+
+/**
+ * @brief Write whatever is queued once the flush delay has passed
+ * The deadline runs from the first message held back, a write started
+ * earlier leaves the timer to expire without effect.
+ */
+template <typename T>
+void connection<T>::arm_flush_timer() {
+    if (flush_armed_) {
+        return;
+    }
+    flush_armed_ = true;
+    flush_timer_.expires_after(options_.coalescing().flush_delay());
+    flush_timer_.async_wait(asio::bind_executor(
+        strand_, [this, self = this->shared_from_this()](
+                     const asio::error_code& error) {
+            flush_armed_ = false;
+            if (!error && is_connected() && writing_messages_.empty() &&
+                !outgoing_messages_.empty()) {
+                write_messages();
+            }
+        }));
+}
+
+/**
+ * @brief Write the messages held back by coalescing without waiting for
+ * the flush threshold or deadline
+ */
+template <typename T>
+void connection<T>::flush() {
+    asio::post(strand_, [this, self = this->shared_from_this()]() {
+        if (is_connected() && writing_messages_.empty() &&
+            !outgoing_messages_.empty()) {
+            write_messages();
+        }
+    });
+}
+
+/**
+ * @brief Account for a message about to be queued, applying the overflow
+ * policy when it would take the queue above the high watermark
+ * A message is always admitted into an empty queue, even one larger than
+ * the byte watermark, so it can be sent at all.
+ *
+ * @return false when the message was refused, its completion has then been
+ * reported as not sent
+ */
+template <typename T>
+bool connection<T>::admit(outgoing_message& entry) {
+    const auto& limits = options_.send_queue();
+    std::size_t bytes =
+        queued_bytes_.load(std::memory_order_relaxed) + entry.frame->size();
+    std::size_t messages = queued_messages_.load(std::memory_order_relaxed) + 1;
+    if (messages > 1 && limits.above_high(bytes, messages)) {
+        switch (limits.overflow_policy()) {
+        case overflow_policy::drop_oldest:
+        case overflow_policy::drop_newest:
+            while (limits.above_high(bytes, messages) &&
+                   !outgoing_messages_.empty()) {
+                auto victim = outgoing_messages_.evict(
+                    limits.overflow_policy() == overflow_policy::drop_oldest);
+                bytes -= victim->frame->size();
+                --messages;
+                discard(*victim);
+                dropped_messages_.fetch_add(1, std::memory_order_relaxed);
+            }
+            break;
+        case overflow_policy::disconnect: {
+            WIRED_LOG_MESSAGE(wired::LOG_INFO,
+                              "{} Outgoing queue above its high watermark, "
+                              "disconnecting the slow consumer",
+                              static_cast<void*>(this));
+            // A TLS close_notify would only queue up behind the backlog
+            asio::error_code error;
+            stream_.close(error);
+            flush_timer_.cancel();
+            dropped_messages_.fetch_add(drop_queued(),
+                                        std::memory_order_relaxed);
+            if (owns_datagram_socket_) {
+                datagram_socket_->close();
+            }
+            [[fallthrough]];
+        }
+        default:
+            writable_.store(false, std::memory_order_release);
+            dropped_messages_.fetch_add(1, std::memory_order_relaxed);
+            discard(entry);
+            return false;
+        }
+    }
+    queued_bytes_.store(bytes, std::memory_order_relaxed);
+    queued_messages_.store(messages, std::memory_order_relaxed);
+    if (limits.at_high(bytes, messages)) {
+        writable_.store(false, std::memory_order_release);
+    }
+    return true;
+}
+
+/**
+ * @brief Account for written messages, calling the drain handler when the
+ * queue falls to its low watermark after having reached the high one
+ */
+template <typename T>
+void connection<T>::release(std::size_t bytes, std::size_t messages) {
+    bytes = queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+    messages = queued_messages_.fetch_sub(messages,
+                                          std::memory_order_relaxed) -
+               messages;
+    if (writable_.load(std::memory_order_relaxed) ||
+        !options_.send_queue().at_low(bytes, messages)) {
+        return;
+    }
+    writable_.store(true, std::memory_order_release);
+    if (drain_handler_ && is_connected()) {
+        drain_handler_();
+    }
+}
+
+/**
+ * @brief Report every message still waiting in the queue as not sent
+ * @return number of messages dropped
+ */
+template <typename T>
+std::size_t connection<T>::drop_queued() {
+    std::size_t bytes = 0;
+    std::size_t messages = 0;
+    outgoing_messages_.for_each([&](outgoing_message& entry) {
+        bytes += entry.frame->size();
+        ++messages;
+        discard(entry);
+    });
+    outgoing_messages_.clear();
+    queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+    queued_messages_.fetch_sub(messages, std::memory_order_relaxed);
+    return messages;
+}
+
+/**
+ * @brief Set the function called on the strand when the connection becomes
+ * writable again
+ */
+template <typename T>
+void connection<T>::set_drain_handler(drain_handler handler) {
+    asio::post(strand_, [this, self = this->shared_from_this(),
+                         handler = std::move(handler)]() mutable {
+        drain_handler_ = std::move(handler);
+    });
+}
+
+/**
+ * @brief Report a message that will never be written as not sent
+ */
+template <typename T>
+void connection<T>::discard(outgoing_message& entry) {
+    if (auto* promise = std::get_if<std::promise<bool>>(&entry.completion)) {
+        promise->set_value(false);
+    } else if (auto* callback = std::get_if<send_callback>(&entry.completion)) {
+        if (*callback) {
+            (*callback)(false);
+        }
+    }
+}
+
+template <typename T>
+void connection<T>::complete(outgoing_message& entry,
+                             std::exception_ptr error) {
+    if (auto* promise = std::get_if<std::promise<bool>>(&entry.completion)) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(true);
+        }
+    } else if (auto* callback = std::get_if<send_callback>(&entry.completion)) {
+        if (*callback) {
+            (*callback)(!error);
+        }
+    }
+}
+
 template <typename T>
 std::future<bool>
 connection<T>::connect(asio::ip::tcp::resolver::results_type& endpoints) {
@@ -175,47 +955,155 @@ connection<T>::connect(asio::ip::tcp::resolver::results_type& endpoints) {
         promise.set_value(false);
         return future;
     }
+    // Resumable TLS sessions are cached per host and port
+    std::string session_key;
+    if (!endpoints.empty()) {
+        session_key = endpoints.begin()->host_name() + ":" +
+                      endpoints.begin()->service_name();
+    }
     asio::async_connect(
-        ssl_stream_.lowest_layer(), endpoints,
-        [this, promise = std::move(promise)](
-            const asio::error_code& error,
-            asio::ip::tcp::endpoint endpoint) mutable {
-            if (error) {
-                WIRED_LOG_MESSAGE(wired::LOG_ERROR,
-                                  "Error while connecting\n"
-                                  "with error code: {}\n"
-                                  "and error message: {}",
-                                  error.value(), error.message());
-                promise.set_value(false);
-                return;
-            }
-            WIRED_LOG_MESSAGE(
-                wired::LOG_INFO,
-                "Connection object [{}] Connected to: {}, trying to "
-                "perform SSL handshake",
-                static_cast<void*>(this), endpoint.address().to_string());
-            ssl_stream_.async_handshake(
-                asio::ssl::stream_base::client,
-                [this, promise = std::move(promise)](
-                    const asio::error_code& error) mutable {
-                    if (error) {
-                        WIRED_LOG_MESSAGE(wired::LOG_ERROR,
-                                          "SSL handshake failed\n"
-                                          "with error code: {}\n"
-                                          "and error message: {}",
-                                          error.value(), error.message());
-                        promise.set_value(false);
-                        return;
-                    }
-                    WIRED_LOG_MESSAGE(wired::LOG_INFO,
-                                      "SSL handshake successful");
-                    read_header();
-                    promise.set_value(true);
-                });
-        });
+        stream_.tcp_socket(), endpoints,
+        asio::bind_executor(
+            strand_, [this, self = this->shared_from_this(),
+                      promise = std::move(promise),
+                      session_key = std::move(session_key)](
+                         const asio::error_code& error,
+                         asio::ip::tcp::endpoint endpoint) mutable {
+                if (error) {
+                    WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                                      "Error while connecting\n"
+                                      "with error code: {}\n"
+                                      "and error message: {}",
+                                      error.value(), error.message());
+                    promise.set_value(false);
+                    return;
+                }
+                WIRED_LOG_MESSAGE(
+                    wired::LOG_INFO,
+                    "Connection object [{}] Connected to: {}, trying to "
+                    "perform {} handshake",
+                    static_cast<void*>(this), endpoint.address().to_string(),
+                    stream_.secure() ? "SSL" : "plaintext");
+                apply_socket_options();
+                if (stream_.secure()) {
+                    tls_session_cache::prepare(stream_.tls().native_handle(),
+                                               session_key);
+                }
+                handshake(std::move(promise));
+            }));
     return future;
 }
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+/**
+ * @brief Connect a connection built on a unix domain socket
+ * endpoint is a filesystem path or, on Linux, an abstract name starting
+ * with a null byte
+ */
+template <typename T>
+std::future<bool> connection<T>::connect(
+    const asio::local::stream_protocol::endpoint& endpoint) {
+    std::promise<bool> promise;
+    std::future<bool> future = promise.get_future();
+    if (is_connected()) {
+        WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                          "Connection object [{}] already connected",
+                          static_cast<void*>(this));
+        promise.set_value(false);
+        return future;
+    }
+    stream_.local_socket().async_connect(
+        endpoint,
+        asio::bind_executor(
+            strand_, [this, self = this->shared_from_this(),
+                      promise = std::move(promise)](
+                         const asio::error_code& error) mutable {
+                if (error) {
+                    WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                                      "Error while connecting\n"
+                                      "with error code: {}\n"
+                                      "and error message: {}",
+                                      error.value(), error.message());
+                    promise.set_value(false);
+                    return;
+                }
+                WIRED_LOG_MESSAGE(wired::LOG_INFO,
+                                  "Connection object [{}] Connected to a "
+                                  "local endpoint",
+                                  static_cast<void*>(this));
+                apply_socket_options();
+                handshake(std::move(promise));
+            }));
+    return future;
+}
+#endif
+
+template <typename T>
+void connection<T>::handshake(std::promise<bool>&& promise) {
+    stream_.async_handshake(
+        handshake_role::client,
+        asio::bind_executor(
+            strand_, [this, self = this->shared_from_this(),
+                      promise = std::move(promise)](
+                         const asio::error_code& error) mutable {
+                if (error) {
+                    WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                                      "Handshake failed\n"
+                                      "with error code: {}\n"
+                                      "and error message: {}",
+                                      error.value(), error.message());
+                    promise.set_value(false);
+                    return;
+                }
+                WIRED_LOG_MESSAGE(wired::LOG_INFO, "Handshake successful");
+                if (stream_.secure()) {
+                    tls_session_cache::record_handshake(
+                        stream_.tls().native_handle());
+                }
+                if (options_.datagrams()) {
+                    open_client_datagrams();
+                }
+                read_messages();
+                promise.set_value(true);
+            }));
+}
+
+/**
+ * @brief Open the client end of the datagram channel, aimed at the port
+ * number of the server's tcp listener
+ * The connection keeps working without datagrams when this fails.
+ */
+template <typename T>
+void connection<T>::open_client_datagrams() {
+    if (!stream_.secure()) {
+        return;
+    }
+    asio::error_code error;
+    auto remote = stream_.tcp_socket().remote_endpoint(error);
+    auto socket = std::make_shared<datagram_socket>(io_context_);
+    asio::ip::udp::endpoint peer(remote.address(), remote.port());
+    if (!error) {
+        socket->socket().open(peer.protocol(), error);
+    }
+    if (error || !enable_datagrams(socket, handshake_role::client, peer)) {
+        WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                          "{} Could not open the datagram channel",
+                          static_cast<void*>(this));
+        return;
+    }
+    owns_datagram_socket_ = true;
+    std::weak_ptr<connection> weak = this->shared_from_this();
+    socket->start([weak](std::vector<uint8_t>&& packet,
+                         const asio::ip::udp::endpoint& from) {
+        if (auto conn = weak.lock()) {
+            conn->receive_datagram(std::move(packet), from);
+        }
+    });
+    socket->send(std::make_shared<const std::vector<uint8_t>>(
+                     datagram_session_.seal(nullptr, 0)),
+                 peer);
+}
+
 template <typename T>
 std::future<bool> connection<T>::disconnect() {
     std::promise<bool> promise;
@@ -230,11 +1118,13 @@ std::future<bool> connection<T>::disconnect() {
                       "Connection object [{}] called disconnect",
                       static_cast<void*>(this));
 
-    asio::post(io_context_, [this, promise = std::move(promise)]() mutable {
+    asio::post(strand_, [this, self = this->shared_from_this(),
+                      promise = std::move(promise)]() mutable {
         asio::error_code error;
+        // The pending wait holds the connection and its held back frames
+        flush_timer_.cancel();
 
-        ssl_stream_.lowest_layer().shutdown(
-            asio::ip::tcp::socket::shutdown_both, error);
+        stream_.shutdown(error);
         if (error) {
             if (is_disconnect_error(error)) {
                 WIRED_LOG_MESSAGE(
@@ -258,7 +1148,7 @@ std::future<bool> connection<T>::disconnect() {
             }
         }
 
-        ssl_stream_.lowest_layer().close(error);
+        stream_.close(error);
         if (error) {
             if (is_disconnect_error(error)) {
                 WIRED_LOG_MESSAGE(
@@ -282,8 +1172,10 @@ std::future<bool> connection<T>::disconnect() {
             }
         }
 
-        outgoing_messages_.clear();
-        incoming_messages_.clear();
+        drop_queued();
+        if (owns_datagram_socket_) {
+            datagram_socket_->close();
+        }
 
         promise.set_value(true);
     });
@@ -293,7 +1185,7 @@ std::future<bool> connection<T>::disconnect() {
 
 template <typename T>
 std::size_t connection<T>::incoming_messages_count() const {
-    return incoming_messages_.size();
+    return incoming_messages_->size();
 }
 
 template <typename T>
@@ -302,81 +1194,192 @@ std::size_t connection<T>::outgoing_messages_count() const {
 }
 
 template <typename T>
-ts_deque<message<T>>& connection<T>::incoming_messages() {
-    return incoming_messages_;
+mpsc_queue<message<T>>& connection<T>::incoming_messages() {
+    return *incoming_messages_;
 }
 
 template <typename T>
-const ts_deque<message<T>>& connection<T>::incoming_messages() const {
-    return incoming_messages_;
+const mpsc_queue<message<T>>& connection<T>::incoming_messages() const {
+    return *incoming_messages_;
 }
 
+/**
+ * @brief Set the function called when the incoming queue gets a message
+ * while the connection is not waiting for its turn already
+ * Must be set before the connection starts reading. The handler runs on
+ * the strand and typically queues the connection for take_turn.
+ */
 template <typename T>
-void connection<T>::read_header() {
-    asio::async_read(
-        ssl_stream_,
-        asio::buffer(&aux_message_.head(), sizeof(message_header<T>)),
-        std::bind(&connection<T>::read_header_handler, this,
-                  std::placeholders::_1, std::placeholders::_2));
+void connection<T>::set_inbox_handler(inbox_handler handler) {
+    inbox_handler_ = std::move(handler);
 }
 
+/**
+ * @brief Move at most quota messages of the incoming queue into batch
+ * Only called by the consumer of the incoming queue. Reading resumes once
+ * the queue drained to half its capacity.
+ *
+ * @return true when messages are left, the connection stays scheduled and
+ * the caller queues it for another turn
+ */
 template <typename T>
-void connection<T>::read_header_handler(const asio::error_code& error,
-                                        std::size_t bytes_transferred) {
-    if (error) {
-        if (is_disconnect_error(error)) {
-            WIRED_LOG_MESSAGE(
-                wired::LOG_INFO,
-                "{} Remote disconnected gracefully from read_header "
-                "with error code: "
-                "{} and error message: {}",
-                static_cast<void*>(this), error.value(), error.message());
-        } else {
+template <typename Container>
+bool connection<T>::take_turn(Container& batch, std::size_t quota) {
+    incoming_messages_->try_pop_n(std::back_inserter(batch), quota);
+    resume_reading();
+    if (!incoming_messages_->empty()) {
+        return true;
+    }
+    scheduled_.store(false, std::memory_order_seq_cst);
+    // A message pushed after the check above found scheduled_ still set
+    return !incoming_messages_->empty() &&
+           !scheduled_.exchange(true, std::memory_order_seq_cst);
+}
+
+/**
+ * @brief Continue reading after the incoming queue was full
+ * Does nothing unless reading is paused and the queue drained to half its
+ * capacity, consumers call it after popping messages.
+ */
+template <typename T>
+void connection<T>::resume_reading() {
+    // Pairs with the fence in pause_reading, either the strand sees the
+    // drained queue or this sees the pause
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!reading_paused_.load(std::memory_order_acquire) ||
+        incoming_messages_->size() > options_.inbox_capacity() / 2) {
+        return;
+    }
+    asio::post(strand_, [this, self = this->shared_from_this()]() {
+        if (reading_paused_.exchange(false, std::memory_order_acq_rel)) {
+            WIRED_LOG_MESSAGE(wired::LOG_DEBUG, "{} Resumed reading",
+                              static_cast<void*>(this));
+            parse_messages();
+        }
+    });
+}
+
+/**
+ * @brief Stop reading while the incoming queue is at its capacity, TCP
+ * flow control then holds the peer back
+ */
+template <typename T>
+bool connection<T>::pause_reading() {
+    std::size_t capacity = options_.inbox_capacity();
+    if (capacity == 0 || incoming_messages_->size() < capacity) {
+        return false;
+    }
+    WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                      "{} Incoming queue holds {} messages, pausing reads",
+                      static_cast<void*>(this), incoming_messages_->size());
+    reading_paused_.store(true, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // The consumer may have drained the queue before the pause was visible
+    // to its resume_reading, nothing would wake the connection up then
+    if (incoming_messages_->size() <= capacity / 2) {
+        reading_paused_.store(false, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Apply options_.socket() to the connected socket
+ * A failed option is logged and otherwise ignored, the connection works
+ * with the operating system's defaults.
+ */
+template <typename T>
+void connection<T>::apply_socket_options() {
+    if (stream_.is_tcp()) {
+        apply_socket_options(stream_.tcp_socket());
+        return;
+    }
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    apply_socket_options(stream_.local_socket());
+#endif
+}
+
+template <typename T>
+template <typename Socket>
+void connection<T>::apply_socket_options(Socket& socket) {
+    const auto& options = options_.socket();
+    auto set = [this, &socket](const auto& option, const char* name) {
+        asio::error_code error;
+        socket.set_option(option, error);
+        if (error) {
             WIRED_LOG_MESSAGE(wired::LOG_ERROR,
-                              "{} Error while reading header "
+                              "Connection object [{}] could not set {} "
                               "with error code: {} "
                               "and error message: {}",
-                              static_cast<void*>(this), error.value(),
+                              static_cast<void*>(this), name, error.value(),
                               error.message());
         }
-        disconnect();
-        return;
+    };
+    if constexpr (std::is_same_v<Socket, asio::ip::tcp::socket>) {
+        set(asio::ip::tcp::no_delay(options.no_delay()), "TCP_NODELAY");
+        set(asio::socket_base::keep_alive(options.keep_alive()),
+            "SO_KEEPALIVE");
     }
-    WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
-                      "Read {} bytes out of expected {} of header",
-                      bytes_transferred, sizeof(message_header<T>));
+    if (options.send_buffer_size() > 0) {
+        set(asio::socket_base::send_buffer_size(
+                static_cast<int>(options.send_buffer_size())),
+            "SO_SNDBUF");
+    }
+    if (options.receive_buffer_size() > 0) {
+        set(asio::socket_base::receive_buffer_size(
+                static_cast<int>(options.receive_buffer_size())),
+            "SO_RCVBUF");
+    }
+}
 
-    if (aux_message_.head().size() > 0) {
-        aux_message_.body().data().resize(aux_message_.head().size());
-        read_body();
-    } else {
-        append_finished_message();
+template <typename T>
+void connection<T>::push_incoming(message_t&& msg) {
+    incoming_messages_->push(std::move(msg));
+    if (inbox_handler_ &&
+        !scheduled_.exchange(true, std::memory_order_seq_cst)) {
+        inbox_handler_();
     }
 }
 
+/**
+ * @brief Read whatever the stream has available into the receive buffer
+ * Unparsed bytes of a frame straddling the previous read are kept and moved
+ * to the front of the buffer when there is no room left behind them.
+ */
 template <typename T>
-void connection<T>::read_body() {
-    asio::async_read(ssl_stream_,
-                     asio::buffer(aux_message_.body().data().data(),
-                                  aux_message_.body().data().size()),
-                     std::bind(&connection<T>::read_body_handler, this,
-                               std::placeholders::_1, std::placeholders::_2));
+void connection<T>::read_messages() {
+    if (read_begin_ == read_end_) {
+        read_begin_ = 0;
+        read_end_ = 0;
+    } else if (read_end_ == read_buffer_.size()) {
+        std::memmove(read_buffer_.data(), read_buffer_.data() + read_begin_,
+                     read_end_ - read_begin_);
+        read_end_ -= read_begin_;
+        read_begin_ = 0;
+    }
+    stream_.async_read_some(
+        asio::buffer(read_buffer_.data() + read_end_,
+                     read_buffer_.size() - read_end_),
+        asio::bind_executor(
+            strand_, std::bind(&connection<T>::read_messages_handler,
+                               this->shared_from_this(),
+                               std::placeholders::_1, std::placeholders::_2)));
 }
 
 template <typename T>
-void connection<T>::read_body_handler(const asio::error_code& error,
-                                      std::size_t bytes_transferred) {
+void connection<T>::read_messages_handler(const asio::error_code& error,
+                                          std::size_t bytes_transferred) {
     if (error) {
         if (is_disconnect_error(error)) {
             WIRED_LOG_MESSAGE(
                 wired::LOG_INFO,
-                "{} Remote disconnected gracefully from read_body "
+                "{} Remote disconnected gracefully from read_messages "
                 "with error code: "
                 "{} and error message: {}",
                 static_cast<void*>(this), error.value(), error.message());
         } else {
             WIRED_LOG_MESSAGE(wired::LOG_ERROR,
-                              "{} Error while reading body "
+                              "{} Error while reading messages "
                               "with error code: {} "
                               "and error message: {}",
                               static_cast<void*>(this), error.value(),
@@ -385,118 +1388,290 @@ void connection<T>::read_body_handler(const asio::error_code& error,
         disconnect();
         return;
     }
-    WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
-                      "Read {} bytes out of expected {} of body",
-                      bytes_transferred, aux_message_.body().data().size());
+    WIRED_LOG_MESSAGE(wired::LOG_DEBUG, "Read {} bytes into receive buffer",
+                      bytes_transferred);
+
+    read_end_ += bytes_transferred;
+    parse_messages();
+}
+
+/**
+ * @brief Decode every complete frame in the receive buffer
+ * A frame that cannot fit in the receive buffer has its body read directly
+ * into aux_message_ instead of growing the buffer.
+ */
+template <typename T>
+void connection<T>::parse_messages() {
+    using decode_status = typename message_header<T>::decode_status;
+
+    std::size_t appended = 0;
+    while (read_end_ > read_begin_) {
+        if (pause_reading()) {
+            return;
+        }
+        const uint8_t* frame = read_buffer_.data() + read_begin_;
+        std::size_t header_size = 0;
+        decode_status status = aux_message_.head().decode(
+            frame, read_end_ - read_begin_, header_size);
+        if (status == decode_status::incomplete) {
+            break;
+        }
+        if (status == decode_status::invalid) {
+            WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                              "{} Received a malformed message header, "
+                              "disconnecting",
+                              static_cast<void*>(this));
+            disconnect();
+            return;
+        }
+        uint64_t size = aux_message_.head().size();
+        if (size > options_.max_frame_size()) {
+            WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                              "{} Peer announced a {} byte message, more "
+                              "than the {} byte limit, disconnecting",
+                              static_cast<void*>(this), size,
+                              options_.max_frame_size());
+            disconnect();
+            return;
+        }
+        std::size_t available = read_end_ - read_begin_ - header_size;
 
-    append_finished_message();
+        if (header_size + size > read_buffer_.size()) {
+            aux_message_.body() = acquire_body(size);
+            std::memcpy(aux_message_.body().data().data(),
+                        frame + header_size, available);
+            read_begin_ = 0;
+            read_end_ = 0;
+            read_body(available);
+            return;
+        }
+        if (available < size) {
+            break;
+        }
+
+        aux_message_.body() = acquire_body(size);
+        if (size > 0) {
+            std::memcpy(aux_message_.body().data().data(),
+                        frame + header_size, size);
+        }
+        read_begin_ += header_size + size;
+        if (!append_finished_message()) {
+            return;
+        }
+        ++appended;
+    }
+    WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                      "Parsed {} messages, {} bytes left in receive buffer",
+                      appended, read_end_ - read_begin_);
+    if (pause_reading()) {
+        return;
+    }
+    read_messages();
 }
 
 template <typename T>
-void connection<T>::write_header() {
-    auto& pair = outgoing_messages_.front();
-    auto& msg = pair.first;
-    asio::async_write(ssl_stream_,
-                      asio::buffer(&msg.head(), sizeof(message_header<T>)),
-                      std::bind(&connection<T>::write_header_handler, this,
-                                std::placeholders::_1, std::placeholders::_2));
+void connection<T>::read_body(std::size_t offset) {
+    asio::async_read(
+        stream_,
+        asio::buffer(aux_message_.body().data().data() + offset,
+                     aux_message_.body().data().size() - offset),
+        asio::bind_executor(
+            strand_, std::bind(&connection<T>::read_body_handler,
+                               this->shared_from_this(),
+                               std::placeholders::_1, std::placeholders::_2)));
 }
 
 template <typename T>
-void connection<T>::write_header_handler(const asio::error_code& error,
-                                         std::size_t bytes_transferred) {
-    auto& pair = outgoing_messages_.front();
-    auto& msg = pair.first;
-    auto& promise = pair.second;
+void connection<T>::read_body_handler(const asio::error_code& error,
+                                      std::size_t bytes_transferred) {
     if (error) {
         if (is_disconnect_error(error)) {
             WIRED_LOG_MESSAGE(
                 wired::LOG_INFO,
-                "{} Remote disconnected gracefully from write_header "
+                "{} Remote disconnected gracefully from read_body "
                 "with error code: "
                 "{} and error message: {}",
                 static_cast<void*>(this), error.value(), error.message());
         } else {
             WIRED_LOG_MESSAGE(wired::LOG_ERROR,
-                              "{} Error while writing header "
+                              "{} Error while reading body "
                               "with error code: {} "
                               "and error message: {}",
                               static_cast<void*>(this), error.value(),
                               error.message());
         }
         disconnect();
-        promise.set_exception(std::make_exception_ptr(std::runtime_error(
-            "Error while writing header: " + std::to_string(error.value()) +
-            " - " + error.message())));
         return;
     }
-    WIRED_LOG_MESSAGE(
-        wired::LOG_DEBUG,
-        "Wrote {} bytes out of expected {} of header successfully",
-        bytes_transferred, sizeof(message_header<T>));
+    WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                      "Read {} bytes of remaining body, total body size {}",
+                      bytes_transferred, aux_message_.body().data().size());
 
-    if (msg.head().size() > 0) {
-        write_body();
-    } else {
-        promise.set_value(true);
-        outgoing_messages_.pop_front();
-        if (outgoing_messages_.size() > 0) {
-            write_header();
-        }
+    if (append_finished_message()) {
+        parse_messages();
     }
 }
 
+/**
+ * @brief Write as many queued messages as the batch limits allow
+ * Messages are taken in the order of the send scheduler and moved into
+ * writing_messages_, so a more urgent message queued meanwhile waits for
+ * the batch in flight instead of preempting a frame halfway.
+ * The serialized frames of the batch are gathered into one buffer sequence
+ * and written with a single async_write.
+ */
 template <typename T>
-void connection<T>::write_body() {
-    auto& pair = outgoing_messages_.front();
-    auto& msg = pair.first;
-    asio::async_write(ssl_stream_,
-                      asio::buffer(msg.body().data().data(), msg.head().size()),
-                      std::bind(&connection<T>::write_body_handler, this,
-                                std::placeholders::_1, std::placeholders::_2));
+void connection<T>::write_messages() {
+    std::size_t batch_bytes = 0;
+    while (!outgoing_messages_.empty() &&
+           writing_messages_.size() < options_.max_write_batch_messages()) {
+        std::size_t level = outgoing_messages_.select();
+        std::size_t frame_size = outgoing_messages_.front(level).frame->size();
+        if (!writing_messages_.empty() &&
+            batch_bytes + frame_size > options_.max_write_batch_bytes()) {
+            break;
+        }
+        batch_bytes += frame_size;
+        writing_messages_.push_back(outgoing_messages_.pop(level));
+    }
+
+    write_buffers_.clear();
+    for (auto& entry : writing_messages_) {
+        write_buffers_.push_back(asio::buffer(*entry.frame));
+    }
+
+    WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                      "Writing {} messages in a batch of {} bytes",
+                      writing_messages_.size(), batch_bytes);
+    auto handler = asio::bind_executor(
+        strand_, std::bind(&connection<T>::write_messages_handler,
+                           this->shared_from_this(), std::placeholders::_1,
+                           std::placeholders::_2));
+    if (!stream_.secure()) {
+        // A plain socket gathers the frames in one writev
+        asio::async_write(stream_, write_buffers_, std::move(handler));
+        return;
+    }
+
+    // ssl::stream encrypts only the first buffer of a sequence per write_some,
+    // flatten the sequence so the whole batch goes out in as few records as
+    // possible
+    write_buffer_.resize(batch_bytes);
+    asio::buffer_copy(asio::buffer(write_buffer_), write_buffers_);
+    asio::async_write(stream_, asio::buffer(write_buffer_), std::move(handler));
 }
 
 template <typename T>
-void connection<T>::write_body_handler(const asio::error_code& error,
-                                       std::size_t bytes_transferred) {
-
-    auto& pair = outgoing_messages_.front();
-    auto& msg = pair.first;
-    auto& promise = pair.second;
+void connection<T>::write_messages_handler(const asio::error_code& error,
+                                           std::size_t bytes_transferred) {
     if (error) {
         if (is_disconnect_error(error)) {
             WIRED_LOG_MESSAGE(
                 wired::LOG_INFO,
-                "{} Remote disconnected gracefully from write_body "
+                "{} Remote disconnected gracefully from write_messages "
                 "with error code: {} "
                 "and error message: {}",
                 static_cast<void*>(this), error.value(), error.message());
         } else {
             WIRED_LOG_MESSAGE(wired::LOG_ERROR,
-                              "{} Error while writing body "
+                              "{} Error while writing messages "
                               "with error code: {} "
                               "and error message: {}",
                               static_cast<void*>(this), error.value(),
                               error.message());
         }
         disconnect();
-        promise.set_exception(std::make_exception_ptr(std::runtime_error(
-            "Error while writing body: " + std::to_string(error.value()) +
-            " - " + error.message())));
+        auto exception = std::make_exception_ptr(std::runtime_error(
+            "Error while writing messages: " + std::to_string(error.value()) +
+            " - " + error.message()));
+        std::size_t bytes = 0;
+        for (auto& entry : writing_messages_) {
+            bytes += entry.frame->size();
+            complete(entry, exception);
+        }
+        queued_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+        queued_messages_.fetch_sub(writing_messages_.size(),
+                                   std::memory_order_relaxed);
+        writing_messages_.clear();
         return;
     }
     WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
-                      "Wrote {} bytes out of expected {} of body successfully",
-                      bytes_transferred, msg.head().size());
-    promise.set_value(true);
-    outgoing_messages_.pop_front();
+                      "Wrote {} bytes for {} messages successfully",
+                      bytes_transferred, writing_messages_.size());
+
+    // Counts are updated before the senders learn their messages went out
+    std::size_t bytes = 0;
+    for (const auto& entry : writing_messages_) {
+        bytes += entry.frame->size();
+    }
+    release(bytes, writing_messages_.size());
+    for (auto& entry : writing_messages_) {
+        complete(entry);
+    }
+    writing_messages_.clear();
     if (outgoing_messages_.size() > 0) {
-        write_header();
+        write_messages();
+    }
+}
+
+/**
+ * @brief Make a body of size bytes, drawing the buffer from the body pool
+ * when there is one
+ */
+template <typename T>
+message_body<T> connection<T>::acquire_body(std::size_t size) {
+    if (body_pool_ && size > 0) {
+        return message_body<T>(body_pool_->acquire(size), body_pool_);
     }
+    message_body<T> body;
+    body.data().resize(size);
+    return body;
 }
 
+/**
+ * @brief Replace aux_message_'s compressed body with the original bytes
+ * Fails on a malformed block or an original size above the frame limit
+ */
 template <typename T>
-void connection<T>::append_finished_message() {
+bool connection<T>::decompress_body() {
+    auto start = std::chrono::steady_clock::now();
+    const auto& compressed = aux_message_.body().data();
+    const uint8_t* in = compressed.data();
+    const uint8_t* end = in + compressed.size();
+    uint64_t original_size = 0;
+    bool overlong = false;
+    if (!message_header<T>::get_varint(in, end, original_size, overlong) ||
+        original_size > options_.max_frame_size()) {
+        return false;
+    }
+
+    message_body<T> body = acquire_body(original_size);
+    if (!lz4_codec::decompress(in, static_cast<std::size_t>(end - in),
+                               body.data().data(), original_size)) {
+        return false;
+    }
+    aux_message_.body() = std::move(body);
+    aux_message_.head().sync(original_size);
+    aux_message_.head().compressed(false);
+    compression_stats_.record_decompression(std::chrono::steady_clock::now() -
+                                            start);
+    return true;
+}
+
+/**
+ * @brief Hand the completed aux_message_ to the incoming queue
+ * Returns false and disconnects when the message cannot be decoded
+ */
+template <typename T>
+bool connection<T>::append_finished_message() {
+    if (aux_message_.head().compressed() && !decompress_body()) {
+        WIRED_LOG_MESSAGE(wired::LOG_ERROR,
+                          "{} Received a malformed compressed body, "
+                          "disconnecting",
+                          static_cast<void*>(this));
+        disconnect();
+        return false;
+    }
     WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
                       "Appended message with header id: {}, header size: {} "
                       "and body size: {}",
@@ -504,10 +1679,44 @@ void connection<T>::append_finished_message() {
                       aux_message_.head().size(),
                       aux_message_.body().data().size());
     aux_message_.from() = this->shared_from_this();
-    incoming_messages_.emplace_back(std::move(aux_message_));
+    aux_message_.encoding(options_.message_encoding());
+    push_incoming(std::move(aux_message_));
     aux_message_.reset();
-    cv_.notify_all();
-    read_header();
+    return true;
+}
+
+/**
+ * @brief Hand a message received as a datagram to the incoming queue
+ * Malformed and compressed frames are dropped, the peer never sends either
+ */
+template <typename T>
+void connection<T>::deliver_datagram(const std::vector<uint8_t>& payload) {
+    using decode_status = typename message_header<T>::decode_status;
+
+    message_header<T> head;
+    std::size_t header_size = 0;
+    if (head.decode(payload.data(), payload.size(), header_size) !=
+            decode_status::complete ||
+        head.size() != payload.size() - header_size || head.compressed()) {
+        WIRED_LOG_MESSAGE(wired::LOG_DEBUG, "{} Dropped a malformed datagram",
+                          static_cast<void*>(this));
+        return;
+    }
+    std::size_t capacity = options_.inbox_capacity();
+    if (capacity > 0 && incoming_messages_->size() >= capacity) {
+        WIRED_LOG_MESSAGE(wired::LOG_DEBUG,
+                          "{} Incoming queue full, dropped a datagram",
+                          static_cast<void*>(this));
+        return;
+    }
+    message_body<T> body = acquire_body(head.size());
+    if (head.size() > 0) {
+        std::memcpy(body.data().data(), payload.data() + header_size,
+                    head.size());
+    }
+    message_t msg(this->shared_from_this(), head, std::move(body));
+    msg.encoding(options_.message_encoding());
+    push_incoming(std::move(msg));
 }
 
 } // namespace wired
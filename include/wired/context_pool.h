@@ -0,0 +1,85 @@
+#ifndef WIRED_CONTEXT_POOL_H
+#define WIRED_CONTEXT_POOL_H
+
+#include <asio.hpp>
+
+#include "wired/tools/log.h"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace wired {
+
+/**
+ * @brief Threads that each run their own io_context
+ * Work is spread over the contexts round robin through next(). A context
+ * per thread keeps the threads from contending on one shared queue.
+ */
+class io_context_pool {
+  public:
+    using executor_type = asio::io_context::executor_type;
+
+  public:
+    explicit io_context_pool(std::size_t threads);
+    io_context_pool(const io_context_pool& other) = delete;
+    ~io_context_pool();
+
+    io_context_pool& operator=(const io_context_pool& other) = delete;
+
+    executor_type next();
+    void stop();
+
+    std::size_t size() const { return contexts_.size(); }
+
+  private:
+    std::vector<std::unique_ptr<asio::io_context>> contexts_;
+    std::vector<asio::executor_work_guard<executor_type>> work_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> next_;
+}; // class io_context_pool
+
+inline io_context_pool::io_context_pool(std::size_t threads)
+    : contexts_(), work_(), threads_(), next_(0) {
+    threads = threads > 0 ? threads : 1;
+    contexts_.reserve(threads);
+    work_.reserve(threads);
+    threads_.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        contexts_.push_back(std::make_unique<asio::io_context>(1));
+        work_.push_back(asio::make_work_guard(*contexts_.back()));
+    }
+    for (auto& context : contexts_) {
+        threads_.emplace_back([&context]() { context->run(); });
+    }
+    WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                      "io_context_pool started {} threads", threads_.size());
+}
+
+inline io_context_pool::~io_context_pool() { stop(); }
+
+inline io_context_pool::executor_type io_context_pool::next() {
+    std::size_t index =
+        next_.fetch_add(1, std::memory_order_relaxed) % contexts_.size();
+    return contexts_[index]->get_executor();
+}
+
+/**
+ * @brief Stop every context, handlers that did not run yet are discarded
+ */
+inline void io_context_pool::stop() {
+    for (auto& context : contexts_) {
+        context->stop();
+    }
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+}
+
+} // namespace wired
+
+#endif // WIRED_CONTEXT_POOL_H
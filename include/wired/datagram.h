@@ -0,0 +1,319 @@
+#ifndef WIRED_DATAGRAM_H
+#define WIRED_DATAGRAM_H
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+
+#include "wired/types.h"
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace wired {
+
+/**
+ * @brief Keys and sequence numbers of one connection's datagram channel
+ * Both peers export the same keying material from their TLS session, so
+ * the channel needs no extra round trip. Every datagram is sealed with
+ * AES-128-GCM under the key of its direction, the nonce is its sequence
+ * number. A datagram that fails authentication or is not newer than the
+ * newest one accepted so far is dropped.
+ *
+ * Wire layout: channel (8) | sequence (8) | ciphertext | tag (16), the
+ * first 16 bytes are authenticated but not encrypted so a server can find
+ * the connection a datagram belongs to.
+ */
+class datagram_session {
+  public:
+    static constexpr std::size_t key_size = 16;
+    static constexpr std::size_t header_size = 16;
+    static constexpr std::size_t tag_size = 16;
+    // Two keys followed by the channel id
+    static constexpr std::size_t material_size = 2 * key_size + 8;
+    // Stays below the path MTU of common links so datagrams never fragment
+    static constexpr std::size_t max_packet_size = 1200;
+    static constexpr std::size_t max_payload_size =
+        max_packet_size - header_size - tag_size;
+
+    datagram_session()
+        : seal_(nullptr, &EVP_CIPHER_CTX_free),
+          open_(nullptr, &EVP_CIPHER_CTX_free), channel_(0), next_sequence_(1),
+          newest_sequence_(0) {}
+
+    bool init(SSL* ssl, handshake_role role);
+    bool init(const uint8_t* material, handshake_role role);
+    bool ready() const { return seal_ != nullptr; }
+    uint64_t channel() const { return channel_; }
+
+    std::vector<uint8_t> seal(const uint8_t* payload, std::size_t size);
+    bool open(const std::vector<uint8_t>& packet,
+              std::vector<uint8_t>& payload);
+
+    static bool peek_channel(const std::vector<uint8_t>& packet,
+                             uint64_t& channel);
+
+  private:
+    using cipher_ptr =
+        std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>;
+
+    static cipher_ptr make_cipher(const uint8_t* key, bool encrypt);
+    static void put_u64(uint8_t* out, uint64_t value);
+    static uint64_t get_u64(const uint8_t* in);
+    static std::array<uint8_t, 12> nonce(uint64_t sequence);
+
+    cipher_ptr seal_;
+    cipher_ptr open_;
+    uint64_t channel_;
+    uint64_t next_sequence_;
+    uint64_t newest_sequence_;
+}; // class datagram_session
+
+/**
+ * @brief Derive the channel keys from an established TLS session
+ * Fails when the session cannot export keying material, e.g. before the
+ * handshake completed.
+ */
+inline bool datagram_session::init(SSL* ssl, handshake_role role) {
+    static constexpr char label[] = "EXPORTER-wired-datagram";
+    std::array<uint8_t, material_size> material;
+    if (SSL_export_keying_material(ssl, material.data(), material.size(),
+                                   label, sizeof(label) - 1, nullptr, 0,
+                                   0) != 1) {
+        return false;
+    }
+    return init(material.data(), role);
+}
+
+/**
+ * @brief Set up from material_size bytes shared by both peers
+ * The client seals with the first key and the server with the second one.
+ */
+inline bool datagram_session::init(const uint8_t* material,
+                                   handshake_role role) {
+    const uint8_t* client_key = material;
+    const uint8_t* server_key = material + key_size;
+    bool client = role == handshake_role::client;
+    seal_ = make_cipher(client ? client_key : server_key, true);
+    open_ = make_cipher(client ? server_key : client_key, false);
+    if (!seal_ || !open_) {
+        seal_.reset();
+        open_.reset();
+        return false;
+    }
+    channel_ = get_u64(material + 2 * key_size);
+    next_sequence_ = 1;
+    newest_sequence_ = 0;
+    return true;
+}
+
+/**
+ * @brief Build the datagram carrying payload, an empty payload only tells
+ * the peer where to reach this end
+ */
+inline std::vector<uint8_t> datagram_session::seal(const uint8_t* payload,
+                                                   std::size_t size) {
+    std::vector<uint8_t> packet(header_size + size + tag_size);
+    uint64_t sequence = next_sequence_++;
+    put_u64(packet.data(), channel_);
+    put_u64(packet.data() + 8, sequence);
+
+    auto iv = nonce(sequence);
+    int length = 0;
+    EVP_EncryptInit_ex(seal_.get(), nullptr, nullptr, nullptr, iv.data());
+    EVP_EncryptUpdate(seal_.get(), nullptr, &length, packet.data(),
+                      static_cast<int>(header_size));
+    if (size > 0) {
+        EVP_EncryptUpdate(seal_.get(), packet.data() + header_size, &length,
+                          payload, static_cast<int>(size));
+    }
+    EVP_EncryptFinal_ex(seal_.get(), packet.data() + header_size + size,
+                        &length);
+    EVP_CIPHER_CTX_ctrl(seal_.get(), EVP_CTRL_GCM_GET_TAG,
+                        static_cast<int>(tag_size),
+                        packet.data() + header_size + size);
+    return packet;
+}
+
+/**
+ * @brief Authenticate and decrypt a datagram into payload
+ * Returns false for a forged, corrupt, replayed or stale datagram.
+ */
+inline bool datagram_session::open(const std::vector<uint8_t>& packet,
+                                   std::vector<uint8_t>& payload) {
+    if (packet.size() < header_size + tag_size ||
+        get_u64(packet.data()) != channel_) {
+        return false;
+    }
+    uint64_t sequence = get_u64(packet.data() + 8);
+    if (sequence <= newest_sequence_) {
+        return false;
+    }
+
+    std::size_t size = packet.size() - header_size - tag_size;
+    payload.resize(size);
+    auto iv = nonce(sequence);
+    int length = 0;
+    EVP_DecryptInit_ex(open_.get(), nullptr, nullptr, nullptr, iv.data());
+    EVP_DecryptUpdate(open_.get(), nullptr, &length, packet.data(),
+                      static_cast<int>(header_size));
+    if (size > 0) {
+        EVP_DecryptUpdate(open_.get(), payload.data(), &length,
+                          packet.data() + header_size,
+                          static_cast<int>(size));
+    }
+    EVP_CIPHER_CTX_ctrl(open_.get(), EVP_CTRL_GCM_SET_TAG,
+                        static_cast<int>(tag_size),
+                        const_cast<uint8_t*>(packet.data() + header_size +
+                                             size));
+    if (EVP_DecryptFinal_ex(open_.get(), payload.data() + size, &length) <=
+        0) {
+        return false;
+    }
+    newest_sequence_ = sequence;
+    return true;
+}
+
+inline bool datagram_session::peek_channel(const std::vector<uint8_t>& packet,
+                                           uint64_t& channel) {
+    if (packet.size() < header_size + tag_size) {
+        return false;
+    }
+    channel = get_u64(packet.data());
+    return true;
+}
+
+inline datagram_session::cipher_ptr
+datagram_session::make_cipher(const uint8_t* key, bool encrypt) {
+    cipher_ptr cipher(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    if (!cipher) {
+        return cipher;
+    }
+    int result = encrypt ? EVP_EncryptInit_ex(cipher.get(), EVP_aes_128_gcm(),
+                                              nullptr, key, nullptr)
+                         : EVP_DecryptInit_ex(cipher.get(), EVP_aes_128_gcm(),
+                                              nullptr, key, nullptr);
+    if (result != 1) {
+        cipher.reset();
+    }
+    return cipher;
+}
+
+inline void datagram_session::put_u64(uint8_t* out, uint64_t value) {
+    for (std::size_t i = 0; i < 8; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+inline uint64_t datagram_session::get_u64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < 8; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (8 * i);
+    }
+    return value;
+}
+
+inline std::array<uint8_t, 12> datagram_session::nonce(uint64_t sequence) {
+    std::array<uint8_t, 12> iv{};
+    put_u64(iv.data() + 4, sequence);
+    return iv;
+}
+
+/**
+ * @brief UDP socket carrying the datagram channels of one or more
+ * connections
+ * A server shares one socket between all of its connections, a client has
+ * its own. Receives and sends are serialized on the socket's strand, every
+ * received datagram is handed to the packet handler as is.
+ */
+class datagram_socket : public std::enable_shared_from_this<datagram_socket> {
+  public:
+    using packet_handler = std::function<void(
+        std::vector<uint8_t>&& packet, const asio::ip::udp::endpoint& from)>;
+
+    explicit datagram_socket(asio::io_context& io_context)
+        : socket_(io_context), strand_(asio::make_strand(io_context)),
+          buffer_(65536), sender_(), handler_() {}
+
+    asio::ip::udp::socket& socket() { return socket_; }
+
+    void start(packet_handler handler);
+    void send(std::shared_ptr<const std::vector<uint8_t>> packet,
+              const asio::ip::udp::endpoint& to);
+    void close();
+
+  private:
+    void receive();
+
+    asio::ip::udp::socket socket_;
+    asio::strand<asio::io_context::executor_type> strand_;
+    std::vector<uint8_t> buffer_;
+    asio::ip::udp::endpoint sender_;
+    packet_handler handler_;
+}; // class datagram_socket
+
+inline void datagram_socket::start(packet_handler handler) {
+    asio::post(strand_, [self = shared_from_this(),
+                         handler = std::move(handler)]() mutable {
+        self->handler_ = std::move(handler);
+        self->receive();
+    });
+}
+
+/**
+ * @brief Send one datagram, delivery is not reported
+ */
+inline void
+datagram_socket::send(std::shared_ptr<const std::vector<uint8_t>> packet,
+                      const asio::ip::udp::endpoint& to) {
+    asio::post(strand_, [self = shared_from_this(), packet, to]() {
+        if (!self->socket_.is_open()) {
+            return;
+        }
+        self->socket_.async_send_to(
+            asio::buffer(*packet), to,
+            asio::bind_executor(self->strand_,
+                                [self, packet](const asio::error_code&,
+                                               std::size_t) {}));
+    });
+}
+
+inline void datagram_socket::close() {
+    asio::post(strand_, [self = shared_from_this()]() {
+        asio::error_code ec;
+        self->socket_.close(ec);
+        self->handler_ = nullptr;
+    });
+}
+
+inline void datagram_socket::receive() {
+    socket_.async_receive_from(
+        asio::buffer(buffer_), sender_,
+        asio::bind_executor(
+            strand_, [self = shared_from_this()](const asio::error_code& error,
+                                                 std::size_t bytes) {
+                if (error == asio::error::operation_aborted ||
+                    !self->socket_.is_open()) {
+                    return;
+                }
+                // Errors such as a port unreachable report of an earlier
+                // send only concern that one datagram
+                if (!error && self->handler_) {
+                    self->handler_(
+                        std::vector<uint8_t>(self->buffer_.begin(),
+                                             self->buffer_.begin() + bytes),
+                        self->sender_);
+                }
+                self->receive();
+            }));
+}
+
+} // namespace wired
+
+#endif // WIRED_DATAGRAM_H
@@ -0,0 +1,274 @@
+#ifndef WIRED_DISPATCHER_H
+#define WIRED_DISPATCHER_H
+
+#include "wired/tools/log.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wired {
+
+/**
+ * @brief Worker pool that runs tasks in parallel while keeping order per key
+ * Every key is hashed onto a lane, a lane is a FIFO of tasks that is owned
+ * by at most one worker at a time, so tasks sharing a key run one after the
+ * other in submission order while tasks on different lanes run concurrently.
+ *
+ * Ready lanes are queued on the deque of their home worker, idle workers
+ * steal lanes from the back of the other workers' deques so a worker stuck
+ * behind a hot lane does not keep the rest of its lanes waiting.
+ *
+ * A task that throws is logged and its lane moves on to the next task.
+ * Stopping discards the tasks that did not start yet.
+ */
+class ordered_dispatcher {
+  public:
+    using task_t = std::function<void()>;
+
+  public:
+    explicit ordered_dispatcher(std::size_t workers,
+                                std::size_t lanes_per_worker = 64);
+    ordered_dispatcher(const ordered_dispatcher& other) = delete;
+    ~ordered_dispatcher();
+
+    ordered_dispatcher& operator=(const ordered_dispatcher& other) = delete;
+
+    void submit(std::size_t key, task_t task);
+    void stop();
+
+    std::size_t workers() const { return workers_.size(); }
+    std::size_t pending() const { return pending_.load(); }
+    std::size_t stolen() const { return stolen_.load(); }
+
+  private:
+    struct lane {
+        std::mutex mutex;
+        std::deque<task_t> tasks;
+        bool scheduled = false;
+    };
+
+    struct worker {
+        std::mutex mutex;
+        std::deque<std::size_t> ready;
+        std::thread thread;
+    };
+
+    static std::size_t mix(std::size_t key);
+    void schedule(std::size_t lane_index, std::size_t worker_index);
+    bool next_lane(std::size_t self, std::size_t& lane_index);
+    void run_lane(std::size_t self, std::size_t lane_index);
+    void worker_loop(std::size_t self);
+
+  private:
+    // Tasks run from a lane before it is handed back to the ready deque
+    static constexpr std::size_t lane_quota_ = 16;
+
+    std::vector<std::unique_ptr<lane>> lanes_;
+    std::vector<std::unique_ptr<worker>> workers_;
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::atomic<std::size_t> ready_lanes_;
+    std::atomic<std::size_t> pending_;
+    std::atomic<std::size_t> stolen_;
+    std::atomic<bool> stopping_;
+}; // class ordered_dispatcher
+
+inline ordered_dispatcher::ordered_dispatcher(std::size_t workers,
+                                              std::size_t lanes_per_worker)
+    : lanes_(), workers_(), idle_mutex_(), idle_cv_(), ready_lanes_(0),
+      pending_(0), stolen_(0), stopping_(false) {
+    workers = workers > 0 ? workers : 1;
+    lanes_per_worker = lanes_per_worker > 0 ? lanes_per_worker : 1;
+    lanes_.reserve(workers * lanes_per_worker);
+    for (std::size_t i = 0; i < workers * lanes_per_worker; ++i) {
+        lanes_.push_back(std::make_unique<lane>());
+    }
+    workers_.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        workers_.push_back(std::make_unique<worker>());
+    }
+    for (std::size_t i = 0; i < workers; ++i) {
+        workers_[i]->thread =
+            std::thread(&ordered_dispatcher::worker_loop, this, i);
+    }
+    WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                      "ordered_dispatcher started {} workers over {} lanes",
+                      workers_.size(), lanes_.size());
+}
+
+inline ordered_dispatcher::~ordered_dispatcher() { stop(); }
+
+/**
+ * @brief Queue a task behind every earlier task submitted with the same key
+ */
+inline void ordered_dispatcher::submit(std::size_t key, task_t task) {
+    std::size_t lane_index = mix(key) % lanes_.size();
+    auto& target = *lanes_[lane_index];
+    bool needs_scheduling = false;
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        ++pending_;
+        target.tasks.push_back(std::move(task));
+        if (!target.scheduled) {
+            target.scheduled = true;
+            needs_scheduling = true;
+        }
+    }
+    if (needs_scheduling) {
+        schedule(lane_index, lane_index % workers_.size());
+    }
+}
+
+/**
+ * @brief Stop the workers, tasks that did not start yet are discarded
+ * Running tasks are waited for, the discarded ones are freed right away and
+ * their number is logged.
+ */
+inline void ordered_dispatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        stopping_ = true;
+    }
+    idle_cv_.notify_all();
+    for (auto& w : workers_) {
+        if (w->thread.joinable()) {
+            w->thread.join();
+        }
+    }
+    std::size_t discarded = 0;
+    for (auto& l : lanes_) {
+        std::lock_guard<std::mutex> lock(l->mutex);
+        discarded += l->tasks.size();
+        l->tasks.clear();
+        l->scheduled = false;
+    }
+    pending_ -= discarded;
+    if (discarded > 0) {
+        WIRED_LOG_MESSAGE(log_level::LOG_WARNING,
+                          "ordered_dispatcher stopped, discarded {} tasks",
+                          discarded);
+    }
+}
+
+/**
+ * @brief Spread keys over the lanes, connection pointers used as keys are
+ * aligned and would otherwise only ever land on a fraction of them
+ */
+inline std::size_t ordered_dispatcher::mix(std::size_t key) {
+    uint64_t x = static_cast<uint64_t>(key);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return static_cast<std::size_t>(x);
+}
+
+/**
+ * @brief Push a lane onto a worker's ready deque and wake an idle worker
+ * The counter is raised first so it never drops below the number of lanes
+ * that are actually queued
+ */
+inline void ordered_dispatcher::schedule(std::size_t lane_index,
+                                         std::size_t worker_index) {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        ++ready_lanes_;
+    }
+    auto& target = *workers_[worker_index];
+    {
+        std::lock_guard<std::mutex> lock(target.mutex);
+        target.ready.push_back(lane_index);
+    }
+    idle_cv_.notify_one();
+}
+
+inline bool ordered_dispatcher::next_lane(std::size_t self,
+                                          std::size_t& lane_index) {
+    {
+        auto& own = *workers_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.ready.empty()) {
+            lane_index = own.ready.front();
+            own.ready.pop_front();
+            --ready_lanes_;
+            return true;
+        }
+    }
+    for (std::size_t i = 1; i < workers_.size(); ++i) {
+        auto& victim = *workers_[(self + i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.ready.empty()) {
+            lane_index = victim.ready.back();
+            victim.ready.pop_back();
+            --ready_lanes_;
+            ++stolen_;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void ordered_dispatcher::run_lane(std::size_t self,
+                                         std::size_t lane_index) {
+    auto& current = *lanes_[lane_index];
+    for (std::size_t i = 0; i < lane_quota_ && !stopping_; ++i) {
+        task_t task;
+        {
+            std::lock_guard<std::mutex> lock(current.mutex);
+            if (current.tasks.empty()) {
+                current.scheduled = false;
+                return;
+            }
+            task = std::move(current.tasks.front());
+            current.tasks.pop_front();
+        }
+        --pending_;
+        try {
+            task();
+        } catch (const std::exception& e) {
+            WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
+                              "ordered_dispatcher task threw: {}", e.what());
+        } catch (...) {
+            WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
+                              "ordered_dispatcher task threw a non standard "
+                              "exception");
+        }
+    }
+
+    if (stopping_) {
+        return;
+    }
+    // Quota used up, requeue behind the other ready lanes of this worker
+    {
+        std::lock_guard<std::mutex> lock(current.mutex);
+        if (current.tasks.empty()) {
+            current.scheduled = false;
+            return;
+        }
+    }
+    schedule(lane_index, self);
+}
+
+inline void ordered_dispatcher::worker_loop(std::size_t self) {
+    while (!stopping_) {
+        std::size_t lane_index;
+        if (next_lane(self, lane_index)) {
+            run_lane(self, lane_index);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idle_mutex_);
+        idle_cv_.wait(lock, [this] { return ready_lanes_ > 0 || stopping_; });
+    }
+}
+
+} // namespace wired
+
+#endif // WIRED_DISPATCHER_H
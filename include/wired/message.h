@@ -3,13 +3,20 @@
 
 #include <asio.hpp>
 
+#include "wired/buffer_pool.h"
 #include "wired/concepts.h"
+#include "wired/schema.h"
 #include "wired/types.h"
 #include "wired/tools/log.h"
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <cstring>
 #include <memory>
+#include <ranges>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 
 namespace wired {
@@ -17,13 +24,48 @@ namespace wired {
 template <typename T>
 class connection;
 
+/**
+ * @brief Fixed size part of a message as it travels over the wire
+ * The in-memory layout is never sent, encode writes a compact little endian
+ * form instead:
+ *   - 1 byte:  wire version in the high nibble, flags in the low nibble
+ *   - varint:  message id
+ *   - varint:  body size
+ *   - varint:  stream id, only present when flag_stream is set
+ *   - 8 bytes: timestamp, only present when flag_timestamp is set
+ * A header with a stream id marks its body as one chunk of a larger payload,
+ * flag_final marks the last chunk of that stream. flag_compressed marks a
+ * body holding the varint original size followed by an LZ4 block.
+ * Varints are LEB128, 7 bits per byte with the lowest group first, so a
+ * small message carries 3 bytes of framing.
+ */
 template <typename T>
 class message_header {
   public:
-    message_header() : id_(), size_(0), timestamp_(0) {}
-    explicit message_header(T id) : id_(id), size_(0), timestamp_(0) {}
+    static constexpr uint8_t wire_version = 1;
+    static constexpr uint8_t flag_timestamp = 1 << 0;
+    static constexpr uint8_t flag_stream = 1 << 1;
+    static constexpr uint8_t flag_final = 1 << 2;
+    static constexpr uint8_t flag_compressed = 1 << 3;
+    static constexpr uint8_t known_flags =
+        flag_timestamp | flag_stream | flag_final | flag_compressed;
+    static constexpr std::size_t max_varint_size = 10;
+    static constexpr std::size_t max_wire_size =
+        1 + 3 * max_varint_size + sizeof(uint64_t);
+
+    enum class decode_status { complete, incomplete, invalid };
+
+  public:
+    message_header()
+        : id_(), size_(0), timestamp_(0), stream_(0), final_chunk_(false),
+          compressed_(false) {}
+    explicit message_header(T id)
+        : id_(id), size_(0), timestamp_(0), stream_(0), final_chunk_(false),
+          compressed_(false) {}
     message_header(const message_header& other)
-        : id_(other.id_), size_(other.size_), timestamp_(other.timestamp_) {}
+        : id_(other.id_), size_(other.size_), timestamp_(other.timestamp_),
+          stream_(other.stream_), final_chunk_(other.final_chunk_),
+          compressed_(other.compressed_) {}
     message_header(message_header&& other) noexcept;
 
     message_header& operator=(const message_header& other);
@@ -32,23 +74,204 @@ class message_header {
     T id() const { return id_; }
     uint64_t size() const { return size_; }
     uint64_t timestamp() const { return timestamp_; }
+    uint64_t stream() const { return stream_; }
+    bool is_chunk() const { return stream_ != 0; }
+    bool final_chunk() const { return final_chunk_; }
+    bool compressed() const { return compressed_; }
 
     void id(T id) { id_ = id; }
     void timestamp(uint64_t timestamp) { timestamp_ = timestamp; }
+    void stream(uint64_t stream, bool final_chunk) {
+        stream_ = stream;
+        final_chunk_ = stream != 0 && final_chunk;
+    }
+    void compressed(bool compressed) { compressed_ = compressed; }
     void sync(uint64_t size) { size_ = size; }
 
+    std::size_t wire_size() const;
+    std::size_t encode(uint8_t* out) const;
+    decode_status decode(const uint8_t* in, std::size_t available,
+                         std::size_t& consumed);
+
+    static std::size_t varint_size(uint64_t value);
+    static uint8_t* put_varint(uint8_t* out, uint64_t value);
+    static bool get_varint(const uint8_t*& in, const uint8_t* end,
+                           uint64_t& value, bool& overlong);
+
+  private:
+    static uint64_t id_to_wire(T id) {
+        if constexpr (std::is_enum_v<T>) {
+            return static_cast<uint64_t>(
+                static_cast<std::underlying_type_t<T>>(id));
+        } else {
+            return static_cast<uint64_t>(id);
+        }
+    }
+
   private:
     T id_;
     uint64_t size_;
     uint64_t timestamp_;
+    uint64_t stream_; // 0 when the message is not part of a stream
+    bool final_chunk_;
+    bool compressed_;
 }; // class message_header
 
 template <typename T>
 message_header<T>::message_header(message_header&& other) noexcept
     : id_(std::move(other.id_)), size_(std::move(other.size_)),
-      timestamp_(std::move(other.timestamp_)) {
+      timestamp_(std::move(other.timestamp_)), stream_(other.stream_),
+      final_chunk_(other.final_chunk_), compressed_(other.compressed_) {
     other.size_ = 0;
     other.timestamp_ = 0;
+    other.stream_ = 0;
+    other.final_chunk_ = false;
+    other.compressed_ = false;
+}
+
+template <typename T>
+std::size_t message_header<T>::wire_size() const {
+    return 1 + varint_size(id_to_wire(id_)) + varint_size(size_) +
+           (stream_ != 0 ? varint_size(stream_) : 0) +
+           (timestamp_ != 0 ? sizeof(uint64_t) : 0);
+}
+
+/**
+ * @brief Write the wire form of the header
+ * out must have room for max_wire_size bytes
+ *
+ * @return number of bytes written
+ */
+template <typename T>
+std::size_t message_header<T>::encode(uint8_t* out) const {
+    uint8_t* begin = out;
+    uint8_t flags = 0;
+    if (timestamp_ != 0) {
+        flags |= flag_timestamp;
+    }
+    if (stream_ != 0) {
+        flags |= final_chunk_ ? flag_stream | flag_final : flag_stream;
+    }
+    if (compressed_) {
+        flags |= flag_compressed;
+    }
+    *out++ = static_cast<uint8_t>(wire_version << 4) | flags;
+    out = put_varint(out, id_to_wire(id_));
+    out = put_varint(out, size_);
+    if (stream_ != 0) {
+        out = put_varint(out, stream_);
+    }
+    if (timestamp_ != 0) {
+        for (std::size_t i = 0; i < sizeof(uint64_t); ++i) {
+            *out++ = static_cast<uint8_t>(timestamp_ >> (8 * i));
+        }
+    }
+    return static_cast<std::size_t>(out - begin);
+}
+
+/**
+ * @brief Read the wire form of a header from the first available bytes
+ * incomplete means more bytes are needed, invalid means the bytes can never
+ * form a header this version understands. consumed is only set on complete
+ */
+template <typename T>
+typename message_header<T>::decode_status
+message_header<T>::decode(const uint8_t* in, std::size_t available,
+                          std::size_t& consumed) {
+    const uint8_t* begin = in;
+    const uint8_t* end = in + available;
+    if (in == end) {
+        return decode_status::incomplete;
+    }
+    uint8_t version = *in >> 4;
+    uint8_t flags = *in & 0x0f;
+    ++in;
+    if (version != wire_version || (flags & ~known_flags) != 0 ||
+        ((flags & flag_final) && !(flags & flag_stream))) {
+        return decode_status::invalid;
+    }
+
+    uint64_t id = 0;
+    uint64_t size = 0;
+    bool overlong = false;
+    if (!get_varint(in, end, id, overlong) ||
+        !get_varint(in, end, size, overlong)) {
+        return overlong ? decode_status::invalid : decode_status::incomplete;
+    }
+    uint64_t stream = 0;
+    if (flags & flag_stream) {
+        if (!get_varint(in, end, stream, overlong)) {
+            return overlong ? decode_status::invalid
+                            : decode_status::incomplete;
+        }
+        if (stream == 0) {
+            return decode_status::invalid;
+        }
+    }
+    uint64_t timestamp = 0;
+    if (flags & flag_timestamp) {
+        if (static_cast<std::size_t>(end - in) < sizeof(uint64_t)) {
+            return decode_status::incomplete;
+        }
+        for (std::size_t i = 0; i < sizeof(uint64_t); ++i) {
+            timestamp |= static_cast<uint64_t>(*in++) << (8 * i);
+        }
+    }
+
+    if constexpr (std::is_enum_v<T>) {
+        id_ = static_cast<T>(static_cast<std::underlying_type_t<T>>(id));
+    } else {
+        id_ = static_cast<T>(id);
+    }
+    size_ = size;
+    timestamp_ = timestamp;
+    stream_ = stream;
+    final_chunk_ = (flags & flag_final) != 0;
+    compressed_ = (flags & flag_compressed) != 0;
+    consumed = static_cast<std::size_t>(in - begin);
+    return decode_status::complete;
+}
+
+template <typename T>
+std::size_t message_header<T>::varint_size(uint64_t value) {
+    std::size_t bytes = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++bytes;
+    }
+    return bytes;
+}
+
+template <typename T>
+uint8_t* message_header<T>::put_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+/**
+ * @brief Decode one varint, false when the input ends first or the varint
+ * is longer than any uint64_t needs, which also sets overlong
+ */
+template <typename T>
+bool message_header<T>::get_varint(const uint8_t*& in, const uint8_t* end,
+                                   uint64_t& value, bool& overlong) {
+    value = 0;
+    for (std::size_t i = 0; i < max_varint_size; ++i) {
+        if (in == end) {
+            return false;
+        }
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    overlong = true;
+    return false;
 }
 
 template <typename T>
@@ -56,6 +279,9 @@ message_header<T>& message_header<T>::operator=(const message_header& other) {
     id_ = other.id_;
     size_ = other.size_;
     timestamp_ = other.timestamp_;
+    stream_ = other.stream_;
+    final_chunk_ = other.final_chunk_;
+    compressed_ = other.compressed_;
     return *this;
 }
 
@@ -65,18 +291,34 @@ message_header<T>::operator=(message_header&& other) noexcept {
     id_ = std::move(other.id_);
     size_ = std::move(other.size_);
     timestamp_ = std::move(other.timestamp_);
+    stream_ = other.stream_;
+    final_chunk_ = other.final_chunk_;
+    compressed_ = other.compressed_;
     other.size_ = 0;
     other.timestamp_ = 0;
+    other.stream_ = 0;
+    other.final_chunk_ = false;
+    other.compressed_ = false;
     return *this;
 }
 
+/**
+ * @brief Body bytes of a message
+ * A body built from a buffer_pool buffer hands that buffer back to the pool
+ * when it is destroyed or overwritten, copies never belong to the pool.
+ */
 template <typename T>
 class message_body {
   public:
-    message_body() : data_() {}
-    message_body(const message_body& other) : data_(other.data_) {}
+    message_body() : data_(), pool_(nullptr) {}
+    message_body(std::vector<uint8_t>&& data,
+                 std::shared_ptr<buffer_pool> pool)
+        : data_(std::move(data)), pool_(std::move(pool)) {}
+    message_body(const message_body& other)
+        : data_(other.data_), pool_(nullptr) {}
     message_body(message_body&& other) noexcept
-        : data_(std::move(other.data_)) {}
+        : data_(std::move(other.data_)), pool_(std::move(other.pool_)) {}
+    ~message_body() { recycle(); }
 
     message_body& operator=(const message_body& other);
     message_body& operator=(message_body&& other) noexcept;
@@ -84,8 +326,12 @@ class message_body {
     const std::vector<uint8_t>& data() const { return data_; }
     std::vector<uint8_t>& data() { return data_; }
 
+  private:
+    void recycle();
+
   private:
     std::vector<uint8_t> data_;
+    std::shared_ptr<buffer_pool> pool_;
 }; // class message_body
 
 template <typename T>
@@ -96,10 +342,24 @@ message_body<T>& message_body<T>::operator=(const message_body& other) {
 
 template <typename T>
 message_body<T>& message_body<T>::operator=(message_body&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    recycle();
     data_ = std::move(other.data_);
+    pool_ = std::move(other.pool_);
     return *this;
 }
 
+template <typename T>
+void message_body<T>::recycle() {
+    if (pool_) {
+        pool_->release(std::move(data_));
+        data_ = std::vector<uint8_t>();
+        pool_.reset();
+    }
+}
+
 template <typename T>
 class message {
   public:
@@ -108,12 +368,19 @@ class message {
     using connection_ptr = std::shared_ptr<connection_t>;
     using message_header_t = message_header<T>;
     using message_body_t = message_body<T>;
+    using length_type = uint64_t;
 
   public:
     message(connection_ptr from, message_header_t head, message_body_t body)
-        : from_(from), head_(head), body_(body) {}
-    message() : from_(nullptr), head_(), body_() {}
-    explicit message(T id) : from_(nullptr), head_(id), body_() {}
+        : from_(std::move(from)), head_(head), body_(std::move(body)),
+          encoding_(message_encoding::stack), read_offset_(0) {}
+    message()
+        : from_(nullptr), head_(), body_(),
+          encoding_(message_encoding::stack), read_offset_(0) {}
+    explicit message(T id,
+                     message_encoding encoding = message_encoding::stack)
+        : from_(nullptr), head_(id), body_(), encoding_(encoding),
+          read_offset_(0) {}
     message(const message& other);
     message(message&& other) noexcept;
 
@@ -129,6 +396,10 @@ class message {
 
     T id() const { return head_.id(); }
     void id(T id) { head_.id(id); }
+    message_encoding encoding() const { return encoding_; }
+    void encoding(message_encoding encoding) { encoding_ = encoding; }
+    std::size_t read_offset() const { return read_offset_; }
+    void rewind() { read_offset_ = 0; }
     void reset();
 
     template <typename U>
@@ -139,6 +410,9 @@ class message {
 
   private:
     template <typename U>
+    void write_selection(U&& data, selection_tag_3) requires
+        has_wired_schema<std::remove_cvref_t<U>>;
+    template <typename U>
     void write_selection(U&& data,
                          selection_tag_2) requires has_wired_serializable<U>;
     template <typename U>
@@ -147,6 +421,9 @@ class message {
     template <typename U>
     void write_selection(U&& data, selection_tag_0);
 
+    template <typename U>
+    void read_selection(U& data,
+                        selection_tag_3) requires has_wired_schema<U>;
     template <typename U>
     void read_selection(U& data,
                         selection_tag_2) requires has_wired_deserializable<U>;
@@ -156,28 +433,39 @@ class message {
     template <typename U>
     void read_selection(U& data, selection_tag_0);
 
+    void write_length(length_type length);
+    length_type read_length();
+
     void sync() { head_.sync(body_.data().size()); }
 
   private:
     connection_ptr from_;
     message_header_t head_;
     message_body_t body_;
+    message_encoding encoding_;
+    std::size_t read_offset_; // Cursor of forward reads into the body
 }; // class message
 
 template <typename T>
 message<T>::message(const message& other)
-    : from_(other.from_), head_(other.head_), body_(other.body_) {}
+    : from_(other.from_), head_(other.head_), body_(other.body_),
+      encoding_(other.encoding_), read_offset_(other.read_offset_) {}
 
 template <typename T>
 message<T>::message(message&& other) noexcept
     : from_(std::move(other.from_)), head_(std::move(other.head_)),
-      body_(std::move(other.body_)) {}
+      body_(std::move(other.body_)), encoding_(other.encoding_),
+      read_offset_(other.read_offset_) {
+    other.read_offset_ = 0;
+}
 
 template <typename T>
 message<T>& message<T>::operator=(const message& other) {
     from_ = other.from_;
     head_ = other.head_;
     body_ = other.body_;
+    encoding_ = other.encoding_;
+    read_offset_ = other.read_offset_;
     return *this;
 }
 
@@ -186,6 +474,9 @@ message<T>& message<T>::operator=(message&& other) noexcept {
     from_ = std::move(other.from_);
     head_ = std::move(other.head_);
     body_ = std::move(other.body_);
+    encoding_ = other.encoding_;
+    read_offset_ = other.read_offset_;
+    other.read_offset_ = 0;
     return *this;
 }
 
@@ -193,12 +484,13 @@ template <typename T>
 void message<T>::reset() {
     head_ = message_header<T>();
     body_.data().clear();
+    read_offset_ = 0;
 }
 
 template <typename T>
 template <typename U>
 message<T>& message<T>::operator<<(U&& data) {
-    write_selection(std::forward<U>(data), selection_tag_2{});
+    write_selection(std::forward<U>(data), selection_tag_3{});
     sync();
     return *this;
 }
@@ -206,17 +498,46 @@ message<T>& message<T>::operator<<(U&& data) {
 template <typename T>
 template <typename U>
 message<T>& message<T>::operator>>(U& data) {
-    read_selection(data, selection_tag_2{});
+    read_selection(data, selection_tag_3{});
     sync();
     return *this;
 }
 
+/**
+ * @brief Write a schema object to the message
+ * schema objects declare their fields through a wired_fields tuple, checked
+ * via the has_wired_schema concept. The body is resized once to the exact
+ * serialized size and schema_codec writes the fields straight into it.
+ * Stack encoding appends the byte length of variable sized objects so they
+ * can be found from the end of the body
+ *
+ * @param selection_tag_3 1st priority tag
+ */
+template <typename T>
+template <typename U>
+void message<T>::write_selection(U&& data, selection_tag_3) requires
+    has_wired_schema<std::remove_cvref_t<U>> {
+    using value_type = std::remove_cvref_t<U>;
+
+    auto& vector = body_.data();
+    std::size_t offset = vector.size();
+    std::size_t bytes = schema_codec::size(data);
+    bool suffix = encoding_ == message_encoding::stack &&
+                  !schema_codec::is_fixed<value_type>();
+    vector.resize(offset + bytes + (suffix ? sizeof(length_type) : 0));
+    uint8_t* out = vector.data() + offset;
+    schema_codec::write(out, data);
+    if (suffix) {
+        schema_codec::put_u64(out, bytes);
+    }
+}
+
 /**
  * @brief Write a serializable object to the message
  * serializable objects are objects that have a wired_serialize method
  * checked via the has_wired_serializable concept
  *
- * @param selection_tag_2 1st priority tag
+ * @param selection_tag_2 2nd priority tag
  */
 template <typename T>
 template <typename U>
@@ -229,29 +550,55 @@ void message<T>::write_selection(U&& data, selection_tag_2) requires
 /**
  * @brief Write a range of data to the message
  * ranges are objects that have a begin and end method
- * checked via the std::ranges::range concept
+ * checked via the std::ranges::range concept, the little endian length
+ * goes after the elements in stack encoding and before them in forward
+ * encoding.
+ * Contiguous ranges of trivially copyable elements are copied in one go
  *
- * @param selection_tag_1 2nd priority tag
+ * @param selection_tag_1 3rd priority tag
  *
  */
 template <typename T>
 template <typename U>
 void message<T>::write_selection(
     U&& data, selection_tag_1) requires std::ranges::range<U> {
-    using size_type = typename std::remove_reference_t<U>::size_type;
+    using value_type = std::ranges::range_value_t<U>;
 
     auto& msg = *this;
-    size_type size = std::ranges::size(data);
-    for (const auto& item : data) {
-        msg << item;
+    length_type size = static_cast<length_type>(std::ranges::size(data));
+    if constexpr (std::ranges::contiguous_range<U> &&
+                  std::is_trivially_copyable_v<value_type>) {
+        auto& vector = body_.data();
+        std::size_t offset = vector.size();
+        std::size_t bytes = size * sizeof(value_type);
+        vector.resize(offset + bytes + sizeof(length_type));
+        if (encoding_ == message_encoding::forward) {
+            schema_codec::put_u64(vector.data() + offset, size);
+            offset += sizeof(length_type);
+        } else {
+            schema_codec::put_u64(vector.data() + offset + bytes, size);
+        }
+        if (bytes > 0) {
+            std::memcpy(vector.data() + offset, std::ranges::data(data),
+                        bytes);
+        }
+    } else {
+        if (encoding_ == message_encoding::forward) {
+            write_length(size);
+        }
+        for (const auto& item : data) {
+            msg << item;
+        }
+        if (encoding_ == message_encoding::stack) {
+            write_length(size);
+        }
     }
-    msg << static_cast<size_type>(size);
 }
 
 /**
  * @brief Write a single object to the message
  *
- * @param selection_tag_0 3rd priority tag
+ * @param selection_tag_0 4th priority tag
  */
 template <typename T>
 template <typename U>
@@ -263,6 +610,35 @@ void message<T>::write_selection(U&& data, selection_tag_0) {
     std::memcpy(msg_vector.data() + size, &data, sizeof(U));
 }
 
+template <typename T>
+template <typename U>
+void message<T>::read_selection(
+    U& data, selection_tag_3) requires has_wired_schema<U> {
+    auto& vector = body_.data();
+    if (encoding_ == message_encoding::forward) {
+        if (read_offset_ > vector.size()) {
+            throw std::out_of_range("Read past the end of the message body");
+        }
+        const uint8_t* in = vector.data() + read_offset_;
+        schema_codec::read(in, vector.data() + vector.size(), data);
+        read_offset_ = in - vector.data();
+        return;
+    }
+
+    std::size_t bytes;
+    if constexpr (schema_codec::is_fixed<U>()) {
+        bytes = schema_codec::fixed_size<U>();
+    } else {
+        bytes = read_length();
+    }
+    if (bytes > vector.size()) {
+        throw std::out_of_range("Schema object exceeds the message body");
+    }
+    const uint8_t* in = vector.data() + vector.size() - bytes;
+    schema_codec::read(in, vector.data() + vector.size(), data);
+    vector.resize(vector.size() - bytes);
+}
+
 template <typename T>
 template <typename U>
 void message<T>::read_selection(U& data, selection_tag_2) requires
@@ -278,11 +654,38 @@ template <typename U>
 void message<T>::read_selection(
     U& data, selection_tag_1) requires std::ranges::range<U> {
     using value_type = typename U::value_type;
-    using size_type = typename U::size_type;
 
     auto& msg = *this;
-    size_type size;
-    msg >> size;
+    length_type size = read_length();
+
+    if constexpr (std::ranges::contiguous_range<U> &&
+                  std::is_trivially_copyable_v<value_type> &&
+                  requires(U & range, std::size_t count) {
+                      range.resize(count);
+                  }) {
+        auto& vector = body_.data();
+        std::size_t available = vector.size();
+        if (encoding_ == message_encoding::forward) {
+            available = available > read_offset_ ? available - read_offset_ : 0;
+        }
+        if (size > available / sizeof(value_type)) {
+            throw std::out_of_range("Range length exceeds the message body");
+        }
+        std::size_t bytes = size * sizeof(value_type);
+        data.resize(size);
+        if (bytes == 0) {
+            return;
+        }
+        if (encoding_ == message_encoding::forward) {
+            std::memcpy(data.data(), vector.data() + read_offset_, bytes);
+            read_offset_ += bytes;
+        } else {
+            std::memcpy(data.data(), vector.data() + vector.size() - bytes,
+                        bytes);
+            vector.resize(vector.size() - bytes);
+        }
+        return;
+    }
 
     data.clear();
     data.reserve(size);
@@ -291,18 +694,52 @@ void message<T>::read_selection(
         msg >> item;
         data.push_back(item);
     }
-    std::reverse(data.begin(), data.end());
+    if (encoding_ == message_encoding::stack) {
+        std::reverse(data.begin(), data.end());
+    }
 }
 
+/**
+ * @brief Read a single object from the message
+ * Stack encoding takes it off the end of the body, forward encoding copies
+ * it from the read cursor and leaves the body as it is
+ *
+ * @param selection_tag_0 4th priority tag
+ */
 template <typename T>
 template <typename U>
 void message<T>::read_selection(U& data, selection_tag_0) {
     auto& msg = *this;
     auto& vector = msg.body().data();
+    if (encoding_ == message_encoding::forward) {
+        if (vector.size() < read_offset_ + sizeof(U)) {
+            throw std::out_of_range("Read past the end of the message body");
+        }
+        std::memcpy(&data, vector.data() + read_offset_, sizeof(U));
+        read_offset_ += sizeof(U);
+        return;
+    }
     std::memcpy(&data, (vector.data() + vector.size()) - sizeof(U), sizeof(U));
     vector.resize(vector.size() - sizeof(U));
 }
 
+/**
+ * @brief Write the length prefix of a range, little endian on any host
+ */
+template <typename T>
+void message<T>::write_length(length_type length) {
+    std::array<uint8_t, sizeof(length_type)> bytes;
+    schema_codec::put_u64(bytes.data(), length);
+    write_selection(bytes, selection_tag_0{});
+}
+
+template <typename T>
+typename message<T>::length_type message<T>::read_length() {
+    std::array<uint8_t, sizeof(length_type)> bytes;
+    read_selection(bytes, selection_tag_0{});
+    return schema_codec::get_u64(bytes.data());
+}
+
 } // namespace wired
 
 #endif // WIRED_MESSAGE_H
\ No newline at end of file
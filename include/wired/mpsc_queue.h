@@ -0,0 +1,191 @@
+#ifndef WIRED_MPSC_QUEUE_H
+#define WIRED_MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace wired {
+
+/**
+ * @brief Lock-free multi-producer single-consumer queue
+ * Linked node queue in the style of Dmitry Vyukov's MPSC queue,
+ * producers only perform one atomic exchange to append a node, the consumer
+ * moves values out without taking any lock.
+ *
+ * push may be called from any thread, every other method except size and
+ * wake must only be called from the single consumer thread.
+ * The consumer can block in wait until a producer appends a value, producers
+ * only touch the futex when the consumer is actually sleeping.
+ */
+template <typename T>
+class mpsc_queue {
+  public:
+    using value_type = T;
+    using size_type = std::size_t;
+
+  public:
+    mpsc_queue();
+    mpsc_queue(const mpsc_queue& other) = delete;
+    ~mpsc_queue();
+
+    mpsc_queue& operator=(const mpsc_queue& other) = delete;
+
+    template <typename... Args>
+    void push(Args&&... args);
+
+    bool try_pop(T& value);
+    template <typename OutputIt>
+    size_type try_pop_n(OutputIt out, size_type max);
+
+    bool empty() const;
+    size_type size() const { return size_.load(std::memory_order_relaxed); }
+    void clear();
+
+    void wait();
+    void wake();
+
+  private:
+    struct node {
+        node() : next(nullptr), value() {}
+        template <typename... Args>
+        explicit node(std::in_place_t, Args&&... args)
+            : next(nullptr), value(std::in_place, std::forward<Args>(args)...) {
+        }
+
+        std::atomic<node*> next;
+        std::optional<T> value;
+    };
+
+  private:
+    alignas(64) std::atomic<node*> head_; // last pushed node, producers
+    alignas(64) node* tail_;              // dummy node, consumer only
+    std::atomic<size_type> size_;
+    std::atomic<bool> waiting_;
+    std::atomic<bool> woken_;
+    std::atomic<uint32_t> signal_;
+}; // class mpsc_queue
+
+template <typename T>
+mpsc_queue<T>::mpsc_queue()
+    : head_(nullptr), tail_(nullptr), size_(0), waiting_(false),
+      woken_(false), signal_(0) {
+    node* dummy = new node();
+    head_.store(dummy, std::memory_order_relaxed);
+    tail_ = dummy;
+}
+
+template <typename T>
+mpsc_queue<T>::~mpsc_queue() {
+    clear();
+    delete tail_;
+}
+
+template <typename T>
+template <typename... Args>
+void mpsc_queue<T>::push(Args&&... args) {
+    node* n = new node(std::in_place, std::forward<Args>(args)...);
+    size_.fetch_add(1, std::memory_order_relaxed);
+    node* prev = head_.exchange(n, std::memory_order_acq_rel);
+    prev->next.store(n, std::memory_order_release);
+
+    // Pairs with the fence in wait, either the consumer sees the new node
+    // or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed)) {
+        signal_.fetch_add(1, std::memory_order_release);
+        signal_.notify_one();
+    }
+}
+
+/**
+ * @brief Move the oldest value out of the queue
+ * May report the queue as empty while a producer is halfway through push,
+ * the value becomes visible as soon as that push completes
+ */
+template <typename T>
+bool mpsc_queue<T>::try_pop(T& value) {
+    node* tail = tail_;
+    node* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr) {
+        return false;
+    }
+    value = std::move(*next->value);
+    next->value.reset();
+    tail_ = next;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    delete tail;
+    return true;
+}
+
+template <typename T>
+template <typename OutputIt>
+typename mpsc_queue<T>::size_type mpsc_queue<T>::try_pop_n(OutputIt out,
+                                                           size_type max) {
+    size_type count = 0;
+    while (count < max) {
+        node* tail = tail_;
+        node* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            break;
+        }
+        *out = std::move(*next->value);
+        ++out;
+        next->value.reset();
+        tail_ = next;
+        delete tail;
+        ++count;
+    }
+    size_.fetch_sub(count, std::memory_order_relaxed);
+    return count;
+}
+
+template <typename T>
+bool mpsc_queue<T>::empty() const {
+    return tail_->next.load(std::memory_order_acquire) == nullptr;
+}
+
+template <typename T>
+void mpsc_queue<T>::clear() {
+    node* next = tail_->next.load(std::memory_order_acquire);
+    while (next != nullptr) {
+        next->value.reset();
+        delete tail_;
+        tail_ = next;
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        next = tail_->next.load(std::memory_order_acquire);
+    }
+}
+
+/**
+ * @brief Block the consumer until the queue is not empty or wake is called
+ * A wake that happens while the consumer is not waiting is remembered and
+ * makes the next wait return immediately. Spurious returns are possible,
+ * callers recheck their own state
+ */
+template <typename T>
+void mpsc_queue<T>::wait() {
+    if (woken_.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    uint32_t signal = signal_.load(std::memory_order_acquire);
+    waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (empty() && !woken_.load(std::memory_order_acquire)) {
+        signal_.wait(signal, std::memory_order_acquire);
+    }
+    waiting_.store(false, std::memory_order_relaxed);
+}
+
+template <typename T>
+void mpsc_queue<T>::wake() {
+    woken_.store(true, std::memory_order_release);
+    signal_.fetch_add(1, std::memory_order_release);
+    signal_.notify_all();
+}
+
+} // namespace wired
+
+#endif // WIRED_MPSC_QUEUE_H
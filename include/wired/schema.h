@@ -0,0 +1,227 @@
+#ifndef WIRED_SCHEMA_H
+#define WIRED_SCHEMA_H
+
+#include "wired/concepts.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ranges>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace wired {
+
+/**
+ * @brief Declare the serialized fields of a type, in wire order
+ * static constexpr auto wired_fields = wired::schema_fields(&point::x, ...);
+ */
+template <typename... Fields>
+constexpr auto schema_fields(Fields... fields) {
+    return std::make_tuple(fields...);
+}
+
+/**
+ * @brief Encoder and decoder generated from wired_fields declarations
+ * A schema type is laid out as its fields one after the other: trivially
+ * copyable fields as their raw bytes, ranges as a little endian uint64_t
+ * length followed by their elements and nested schema types recursively. A
+ * type whose fields are all trivially copyable or fixed schema types has a
+ * size known at compile time, any other is sized in one pass before it is
+ * written.
+ *
+ * write and read work on raw pointers, the caller sizes the destination
+ * once with size and write never checks capacity again. read checks every
+ * field against the end of the input and throws std::out_of_range.
+ */
+class schema_codec {
+  public:
+    using length_type = uint64_t;
+
+  public:
+    template <typename F>
+    static constexpr bool is_fixed();
+    template <typename F>
+    static constexpr std::size_t fixed_size();
+
+    template <typename F>
+    static std::size_t size(const F& value);
+    template <typename F>
+    static void write(uint8_t*& out, const F& value);
+    template <typename F>
+    static void read(const uint8_t*& in, const uint8_t* end, F& value);
+
+    // Range lengths are little endian whatever the host byte order
+    static void put_u64(uint8_t* out, uint64_t value) {
+        for (std::size_t i = 0; i < sizeof(uint64_t); ++i) {
+            out[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+    static uint64_t get_u64(const uint8_t* in) {
+        uint64_t value = 0;
+        for (std::size_t i = 0; i < sizeof(uint64_t); ++i) {
+            value |= static_cast<uint64_t>(in[i]) << (8 * i);
+        }
+        return value;
+    }
+
+  private:
+    template <typename M>
+    struct member_of;
+    template <typename C, typename V>
+    struct member_of<V C::*> {
+        using type = std::remove_cvref_t<V>;
+    };
+    template <typename M>
+    using member_t = typename member_of<M>::type;
+
+    template <typename F>
+    static constexpr bool is_raw() {
+        return std::is_trivially_copyable_v<F> && !std::ranges::view<F> &&
+               !has_wired_schema<F>;
+    }
+
+    static void check(const uint8_t* in, const uint8_t* end,
+                      std::size_t bytes) {
+        if (static_cast<std::size_t>(end - in) < bytes) {
+            throw std::out_of_range("Schema field exceeds the message body");
+        }
+    }
+}; // class schema_codec
+
+template <typename F>
+constexpr bool schema_codec::is_fixed() {
+    if constexpr (has_wired_schema<F>) {
+        return []<typename... M>(std::tuple<M...>*) {
+            return (is_fixed<member_t<M>>() && ...);
+        }(static_cast<std::remove_cvref_t<decltype(F::wired_fields)>*>(
+                   nullptr));
+    } else {
+        return is_raw<F>();
+    }
+}
+
+template <typename F>
+constexpr std::size_t schema_codec::fixed_size() {
+    static_assert(is_fixed<F>(), "Type has no compile time size");
+    if constexpr (has_wired_schema<F>) {
+        return []<typename... M>(std::tuple<M...>*) {
+            return (fixed_size<member_t<M>>() + ... + 0);
+        }(static_cast<std::remove_cvref_t<decltype(F::wired_fields)>*>(
+                   nullptr));
+    } else {
+        return sizeof(F);
+    }
+}
+
+template <typename F>
+std::size_t schema_codec::size(const F& value) {
+    if constexpr (is_fixed<F>()) {
+        return fixed_size<F>();
+    } else if constexpr (has_wired_schema<F>) {
+        return std::apply(
+            [&value](auto... fields) {
+                return (size(value.*fields) + ... + 0);
+            },
+            F::wired_fields);
+    } else if constexpr (std::ranges::range<F>) {
+        using value_type = std::ranges::range_value_t<F>;
+        if constexpr (std::ranges::sized_range<F> && is_raw<value_type>()) {
+            return sizeof(length_type) +
+                   std::ranges::size(value) * sizeof(value_type);
+        } else {
+            std::size_t bytes = sizeof(length_type);
+            for (const auto& item : value) {
+                bytes += size(item);
+            }
+            return bytes;
+        }
+    } else {
+        static_assert(is_raw<F>(), "Schema fields must be trivially "
+                                   "copyable, ranges or schema types");
+    }
+}
+
+template <typename F>
+void schema_codec::write(uint8_t*& out, const F& value) {
+    if constexpr (has_wired_schema<F>) {
+        std::apply([&out, &value](
+                       auto... fields) { (write(out, value.*fields), ...); },
+                   F::wired_fields);
+    } else if constexpr (is_raw<F>()) {
+        std::memcpy(out, &value, sizeof(F));
+        out += sizeof(F);
+    } else if constexpr (std::ranges::range<F>) {
+        using value_type = std::ranges::range_value_t<F>;
+        length_type length =
+            static_cast<length_type>(std::ranges::distance(value));
+        put_u64(out, length);
+        out += sizeof(length_type);
+        if constexpr (std::ranges::contiguous_range<F> &&
+                      is_raw<value_type>()) {
+            std::size_t bytes = length * sizeof(value_type);
+            if (bytes > 0) {
+                std::memcpy(out, std::ranges::data(value), bytes);
+            }
+            out += bytes;
+        } else {
+            for (const auto& item : value) {
+                write(out, item);
+            }
+        }
+    } else {
+        static_assert(is_raw<F>(), "Schema fields must be trivially "
+                                   "copyable, ranges or schema types");
+    }
+}
+
+template <typename F>
+void schema_codec::read(const uint8_t*& in, const uint8_t* end, F& value) {
+    if constexpr (has_wired_schema<F>) {
+        std::apply([&in, end, &value](
+                       auto... fields) { (read(in, end, value.*fields), ...); },
+                   F::wired_fields);
+    } else if constexpr (is_raw<F>()) {
+        check(in, end, sizeof(F));
+        std::memcpy(&value, in, sizeof(F));
+        in += sizeof(F);
+    } else if constexpr (std::ranges::range<F>) {
+        using value_type = std::ranges::range_value_t<F>;
+        check(in, end, sizeof(length_type));
+        length_type length = get_u64(in);
+        in += sizeof(length_type);
+        if constexpr (std::ranges::contiguous_range<F> &&
+                      is_raw<value_type>() &&
+                      requires(F & range, std::size_t count) {
+                          range.resize(count);
+                      }) {
+            if (length > static_cast<std::size_t>(end - in) /
+                             sizeof(value_type)) {
+                throw std::out_of_range(
+                    "Schema field exceeds the message body");
+            }
+            std::size_t bytes = length * sizeof(value_type);
+            value.resize(length);
+            if (bytes > 0) {
+                std::memcpy(std::ranges::data(value), in, bytes);
+            }
+            in += bytes;
+        } else {
+            value.clear();
+            for (length_type i = 0; i < length; ++i) {
+                value_type item{};
+                read(in, end, item);
+                value.insert(value.end(), std::move(item));
+            }
+        }
+    } else {
+        static_assert(is_raw<F>(), "Schema fields must be trivially "
+                                   "copyable, ranges or schema types");
+    }
+}
+
+} // namespace wired
+
+#endif // WIRED_SCHEMA_H
@@ -0,0 +1,294 @@
+#ifndef WIRED_SEND_SCHEDULER_H
+#define WIRED_SEND_SCHEDULER_H
+
+#include "wired/types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <vector>
+
+namespace wired {
+
+/**
+ * @brief Queue depth and throughput of every priority level of a connection
+ * Updated with relaxed atomics, readers get a consistent value per counter
+ * but not across counters.
+ */
+class send_scheduler_stats {
+  public:
+    explicit send_scheduler_stats(std::size_t levels) : levels_(levels) {}
+
+    void record_push(std::size_t level, std::size_t bytes) {
+        auto& counters = levels_[level];
+        std::size_t depth =
+            counters.queued_messages.fetch_add(1, std::memory_order_relaxed) +
+            1;
+        counters.queued_bytes.fetch_add(bytes, std::memory_order_relaxed);
+        std::size_t peak =
+            counters.peak_messages.load(std::memory_order_relaxed);
+        while (depth > peak && !counters.peak_messages.compare_exchange_weak(
+                                   peak, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    // sent is false for a message discarded before it was written
+    void record_pop(std::size_t level, std::size_t bytes, bool sent,
+                    bool promoted) {
+        auto& counters = levels_[level];
+        counters.queued_messages.fetch_sub(1, std::memory_order_relaxed);
+        counters.queued_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+        if (sent) {
+            counters.sent_messages.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (promoted) {
+            counters.promotions.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t levels() const { return levels_.size(); }
+    std::size_t queued_messages(std::size_t level) const {
+        return levels_[level].queued_messages.load(std::memory_order_relaxed);
+    }
+    std::size_t queued_bytes(std::size_t level) const {
+        return levels_[level].queued_bytes.load(std::memory_order_relaxed);
+    }
+    // Deepest the level's queue has been
+    std::size_t peak_messages(std::size_t level) const {
+        return levels_[level].peak_messages.load(std::memory_order_relaxed);
+    }
+    uint64_t sent_messages(std::size_t level) const {
+        return levels_[level].sent_messages.load(std::memory_order_relaxed);
+    }
+    // Messages served early because the level was starving
+    uint64_t promotions(std::size_t level) const {
+        return levels_[level].promotions.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct level_counters {
+        std::atomic<std::size_t> queued_messages{0};
+        std::atomic<std::size_t> queued_bytes{0};
+        std::atomic<std::size_t> peak_messages{0};
+        std::atomic<uint64_t> sent_messages{0};
+        std::atomic<uint64_t> promotions{0};
+    };
+
+    std::vector<level_counters> levels_;
+}; // class send_scheduler_stats
+
+/**
+ * @brief Outgoing messages of one connection, split by priority level
+ * select picks the level the next message comes from as described by
+ * send_scheduler_options, pop then takes that message out. Not thread
+ * safe, a connection only touches it on its strand, except for stats and
+ * size.
+ */
+template <typename Entry>
+class send_scheduler {
+  public:
+    explicit send_scheduler(const send_scheduler_options& options);
+    send_scheduler(send_scheduler&& other) noexcept;
+
+    std::size_t levels() const { return levels_.size(); }
+    std::size_t level_of(message_strategy strategy) const {
+        return std::min<std::size_t>(static_cast<std::size_t>(strategy),
+                                     levels_.size() - 1);
+    }
+    bool empty() const { return size() == 0; }
+    std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+    const send_scheduler_stats& stats() const { return stats_; }
+
+    void push(message_strategy strategy, Entry&& entry, std::size_t bytes);
+    std::size_t select();
+    Entry& front(std::size_t level) {
+        return levels_[level].items.front().entry;
+    }
+    Entry pop(std::size_t level);
+    std::optional<Entry> evict(bool oldest);
+
+    template <typename Func>
+    void for_each(Func func);
+    void clear();
+
+  private:
+    struct item {
+        Entry entry;
+        std::size_t bytes;
+    };
+
+    struct level {
+        std::deque<item> items;
+        std::size_t deficit = 0; // Bytes the weighted level may still send
+        std::size_t passes = 0;  // Picks of other levels while non-empty
+    };
+
+    std::size_t select_weighted();
+    void advance();
+
+    std::vector<level> levels_;
+    std::size_t strict_levels_;
+    std::vector<std::size_t> quanta_; // Deficit credited per round
+    std::size_t starvation_limit_;
+    std::size_t cursor_; // Weighted level being served
+    std::atomic<std::size_t> size_;
+    send_scheduler_stats stats_;
+}; // class send_scheduler
+
+template <typename Entry>
+send_scheduler<Entry>::send_scheduler(const send_scheduler_options& options)
+    : levels_(options.levels()), strict_levels_(options.strict_levels()),
+      quanta_(options.levels()), starvation_limit_(options.starvation_limit()),
+      cursor_(options.strict_levels()), size_(0), stats_(options.levels()) {
+    for (std::size_t i = 0; i < levels_.size(); ++i) {
+        quanta_[i] = options.quantum() * options.weight(i);
+    }
+    if (cursor_ < levels_.size()) {
+        levels_[cursor_].deficit = quanta_[cursor_];
+    }
+}
+
+template <typename Entry>
+send_scheduler<Entry>::send_scheduler(send_scheduler&& other) noexcept
+    : levels_(std::move(other.levels_)), strict_levels_(other.strict_levels_),
+      quanta_(std::move(other.quanta_)),
+      starvation_limit_(other.starvation_limit_), cursor_(other.cursor_),
+      size_(other.size_.load()), stats_(std::move(other.stats_)) {}
+
+template <typename Entry>
+void send_scheduler<Entry>::push(message_strategy strategy, Entry&& entry,
+                                 std::size_t bytes) {
+    std::size_t index = level_of(strategy);
+    levels_[index].items.push_back(item{std::move(entry), bytes});
+    size_.fetch_add(1, std::memory_order_relaxed);
+    stats_.record_push(index, bytes);
+}
+
+/**
+ * @brief Level of the message to write next, the scheduler must not be
+ * empty
+ * A starving level comes first, then the strict levels in order, then the
+ * weighted levels by deficit round robin.
+ */
+template <typename Entry>
+std::size_t send_scheduler<Entry>::select() {
+    if (starvation_limit_ > 0) {
+        for (std::size_t i = 0; i < levels_.size(); ++i) {
+            if (!levels_[i].items.empty() &&
+                levels_[i].passes >= starvation_limit_) {
+                return i;
+            }
+        }
+    }
+    for (std::size_t i = 0; i < strict_levels_; ++i) {
+        if (!levels_[i].items.empty()) {
+            return i;
+        }
+    }
+    return select_weighted();
+}
+
+/**
+ * @brief Move on from the weighted level at the cursor until one has
+ * credit for the message at its head
+ * Every round a level gets its quantum, an empty level forfeits what it
+ * had saved.
+ */
+template <typename Entry>
+std::size_t send_scheduler<Entry>::select_weighted() {
+    for (;;) {
+        level& current = levels_[cursor_];
+        if (current.items.empty()) {
+            current.deficit = 0;
+        } else if (current.items.front().bytes <= current.deficit) {
+            return cursor_;
+        }
+        advance();
+    }
+}
+
+template <typename Entry>
+void send_scheduler<Entry>::advance() {
+    cursor_ = cursor_ + 1 < levels_.size() ? cursor_ + 1 : strict_levels_;
+    levels_[cursor_].deficit += quanta_[cursor_];
+}
+
+/**
+ * @brief Take the message at the head of level, as returned by select
+ */
+template <typename Entry>
+Entry send_scheduler<Entry>::pop(std::size_t index) {
+    level& chosen = levels_[index];
+    item next = std::move(chosen.items.front());
+    chosen.items.pop_front();
+    size_.fetch_sub(1, std::memory_order_relaxed);
+
+    bool promoted = starvation_limit_ > 0 && chosen.passes >= starvation_limit_;
+    chosen.passes = 0;
+    if (index >= strict_levels_) {
+        chosen.deficit -= std::min(chosen.deficit, next.bytes);
+    }
+    for (std::size_t i = 0; i < levels_.size(); ++i) {
+        if (i != index && !levels_[i].items.empty()) {
+            ++levels_[i].passes;
+        }
+    }
+    stats_.record_pop(index, next.bytes, true, promoted);
+    return std::move(next.entry);
+}
+
+/**
+ * @brief Remove the oldest or newest message of the least urgent level
+ * that has any
+ */
+template <typename Entry>
+std::optional<Entry> send_scheduler<Entry>::evict(bool oldest) {
+    for (std::size_t i = levels_.size(); i-- > 0;) {
+        auto& items = levels_[i].items;
+        if (items.empty()) {
+            continue;
+        }
+        item victim = std::move(oldest ? items.front() : items.back());
+        if (oldest) {
+            items.pop_front();
+        } else {
+            items.pop_back();
+        }
+        if (items.empty()) {
+            levels_[i].passes = 0;
+        }
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        stats_.record_pop(i, victim.bytes, false, false);
+        return std::move(victim.entry);
+    }
+    return std::nullopt;
+}
+
+template <typename Entry>
+template <typename Func>
+void send_scheduler<Entry>::for_each(Func func) {
+    for (auto& current : levels_) {
+        for (auto& queued : current.items) {
+            func(queued.entry);
+        }
+    }
+}
+
+template <typename Entry>
+void send_scheduler<Entry>::clear() {
+    for (std::size_t i = 0; i < levels_.size(); ++i) {
+        for (const auto& queued : levels_[i].items) {
+            stats_.record_pop(i, queued.bytes, false, false);
+        }
+        levels_[i].items.clear();
+        levels_[i].passes = 0;
+    }
+    size_.store(0, std::memory_order_relaxed);
+}
+
+} // namespace wired
+
+#endif // WIRED_SEND_SCHEDULER_H
@@ -5,44 +5,198 @@
 #include <asio/ssl.hpp>
 
 #include "wired/connection.h"
+#include "wired/context_pool.h"
+#include "wired/dispatcher.h"
 #include "wired/message.h"
+#include "wired/mpsc_queue.h"
+#include "wired/tls_session.h"
 #include "wired/tools/log.h"
 #include "wired/ts_deque.h"
 #include "wired/types.h"
 
+#include <atomic>
+#include <cerrno>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace wired {
+
+/**
+ * @brief Counters of a server's accept loop
+ * The counters only grow, sampling them at an interval gives the accept
+ * and handshake rates. pending_handshakes is the number in flight now.
+ */
+class accept_stats {
+  public:
+    accept_stats()
+        : accepted_(0), accept_errors_(0), completed_(0), failed_(0),
+          timed_out_(0), pending_(0) {}
+
+    void record_accept() { accepted_.fetch_add(1, std::memory_order_relaxed); }
+    void record_accept_error() {
+        accept_errors_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void record_handshake(bool completed, bool timed_out) {
+        if (completed) {
+            completed_.fetch_add(1, std::memory_order_relaxed);
+        } else if (timed_out) {
+            timed_out_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            failed_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void set_pending_handshakes(std::size_t count) {
+        pending_.store(count, std::memory_order_relaxed);
+    }
+
+    uint64_t accepted() const {
+        return accepted_.load(std::memory_order_relaxed);
+    }
+    // Accepts that failed, the accept loop carries on after each
+    uint64_t accept_errors() const {
+        return accept_errors_.load(std::memory_order_relaxed);
+    }
+    uint64_t handshakes_completed() const {
+        return completed_.load(std::memory_order_relaxed);
+    }
+    uint64_t handshakes_failed() const {
+        return failed_.load(std::memory_order_relaxed);
+    }
+    uint64_t handshakes_timed_out() const {
+        return timed_out_.load(std::memory_order_relaxed);
+    }
+    std::size_t pending_handshakes() const {
+        return pending_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> accepted_;
+    std::atomic<uint64_t> accept_errors_;
+    std::atomic<uint64_t> completed_;
+    std::atomic<uint64_t> failed_;
+    std::atomic<uint64_t> timed_out_;
+    std::atomic<std::size_t> pending_;
+}; // class accept_stats
+
 template <typename T>
 class server_interface {
   public:
     using message_t = message<T>;
     using connection_t = connection<T>;
     using connection_ptr = std::shared_ptr<connection_t>;
+    using send_callback = typename connection_t::send_callback;
+    using stream_source = typename connection_t::stream_source;
 
   public:
     virtual void on_message(message_t& msg, connection_ptr conn) = 0;
 
+    /**
+     * @brief Receive one chunk of a streamed payload
+     * Chunks of a stream arrive in order, msg.head().stream() tells the
+     * streams apart and msg.head().final_chunk() marks the last one.
+     * Defaults to on_message.
+     */
+    virtual void on_chunk(message_t& msg, connection_ptr conn) {
+        on_message(msg, conn);
+    }
+
+    /**
+     * @brief Key deciding which messages must be handled in order
+     * Only used when message workers are enabled, messages with equal keys
+     * reach on_message one at a time in arrival order. Defaults to the
+     * sending connection, override to order by e.g. a game room instead.
+     */
+    virtual std::size_t ordering_key(const message_t& msg) {
+        return reinterpret_cast<std::uintptr_t>(msg.from().get());
+    }
+
+    /**
+     * @brief The outgoing queue of conn drained to its low watermark after
+     * having reached the high one
+     * Runs on the connection's strand, keep it short.
+     */
+    virtual void on_writable([[maybe_unused]] connection_ptr conn) {}
+
   public:
     server_interface();
     virtual ~server_interface();
 
   public:
     void start(const std::string& port);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    void start_local(const asio::local::stream_protocol::endpoint& endpoint);
+#endif
     void shutdown();
 
     bool is_listening();
 
     void set_tls_options(const tls_options& options) { options_ = options; }
+    void set_connection_options(const connection_options& options) {
+        connection_options_ = options;
+    }
+    // Shorthand for the compression of connection_options
+    void set_compression_options(const compression_options& options) {
+        connection_options_.set_compression(options);
+    }
+    // Compression done by send_all and post_all, per connection counters
+    // are kept by each connection
+    const wired::compression_stats& compression_stats() const {
+        return compression_stats_;
+    }
+    // Must be set before start
+    void set_accept_options(const accept_options& options) {
+        accept_options_ = options;
+    }
+    const wired::accept_stats& accept_stats() const { return accept_stats_; }
+    // Full and resumed handshakes of accepted tls connections
+    const tls_handshake_stats& handshake_stats() const {
+        return handshake_stats_;
+    }
+    const tls_ticket_keys& ticket_keys() const { return ticket_keys_; }
+    // Number of threads running the io_context, must be set before start
+    void set_io_threads(std::size_t count) {
+        io_threads_ = count > 0 ? count : 1;
+    }
+    // Threads running on_message, 0 keeps it on the messaging loop thread
+    void set_message_workers(std::size_t count) { message_workers_ = count; }
+    // Messages the messaging loop takes from one connection before serving
+    // the next one
+    void set_messages_per_turn(std::size_t count) {
+        messages_per_turn_ = count > 0 ? count : 1;
+    }
 
     std::future<bool>
     send(connection_ptr conn, const message_t& msg,
          message_strategy strategy = message_strategy::normal);
 
+    void send(connection_ptr conn, const message_t& msg,
+              send_callback callback,
+              message_strategy strategy = message_strategy::normal);
+
+    void post(connection_ptr conn, const message_t& msg,
+              message_strategy strategy = message_strategy::normal);
+
+    std::future<bool>
+    send_stream(connection_ptr conn, T id, stream_source source,
+                std::size_t chunk_size = 64 * 1024,
+                message_strategy strategy = message_strategy::normal);
+
     std::vector<std::future<bool>>
     send_all(connection_ptr ignore, const message_t& msg,
              message_strategy strategy = message_strategy::normal);
 
+    void post_all(connection_ptr ignore, const message_t& msg,
+                  message_strategy strategy = message_strategy::normal);
+
+    bool send_unreliable(connection_ptr conn, const message_t& msg);
+
+    void send_all_unreliable(connection_ptr ignore, const message_t& msg);
+
     std::future<bool> kick(connection_ptr conn);
 
     void run(execution_policy policy = execution_policy::blocking);
@@ -51,59 +205,245 @@ class server_interface {
 
   private:
     void messaging_loop();
+    void deliver(message_t& msg);
     void contribute_to_context_pool();
+    void start_io_threads();
+    connection_ptr make_connection(asio::ip::tcp::socket&& socket);
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    connection_ptr
+    make_connection(asio::local::stream_protocol::socket&& socket);
+#endif
+    connection_ptr attach(connection_ptr conn);
     void on_message_notify_callback();
-    void wait_for_client_chain();
+    void open_datagrams(const asio::ip::tcp::endpoint& endpoint);
+    void route_datagram(std::vector<uint8_t>&& packet,
+                        const asio::ip::udp::endpoint& from);
+    void enable_datagrams(const connection_ptr& conn);
+    template <typename Acceptor>
+    void wait_for_client_chain(Acceptor& acceptor);
+    template <typename Acceptor>
+    void retry_accept(Acceptor& acceptor);
+    static bool is_exhaustion_error(const asio::error_code& error);
+    void handshake(connection_ptr conn);
+    void complete_handshake(connection_ptr conn, const asio::error_code& error,
+                            bool timed_out);
+    void finish_handshake();
 
   private:
+    // Declared before context_, handlers left on context_ may still refer
+    // to the pool's contexts when it is destroyed
+    std::unique_ptr<io_context_pool> handshake_pool_;
     asio::io_context context_;
-    asio::ssl::context ssl_context_;
+    // Only created for a tls transport
+    std::optional<asio::ssl::context> ssl_context_;
+    tls_ticket_keys ticket_keys_;
+    tls_handshake_stats handshake_stats_;
     asio::executor_work_guard<asio::io_context::executor_type> idle_work_;
-    std::thread asio_thread_;
+    std::size_t io_threads_;
+    std::vector<std::thread> asio_threads_;
     asio::ip::tcp::acceptor acceptor_;
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    asio::local::stream_protocol::acceptor local_acceptor_;
+    std::string local_path_; // Socket file removed on shutdown
+#endif
     ts_deque<connection_ptr> connections_;
-    ts_deque<message_t> messages_;
+    // Shared by the datagram channels of all connections
+    std::shared_ptr<datagram_socket> datagram_socket_;
+    std::mutex datagram_mutex_;
+    std::unordered_map<uint64_t, std::weak_ptr<connection_t>>
+        datagram_channels_;
+    // Connections with received messages, served round robin
+    mpsc_queue<connection_ptr> ready_connections_;
+    std::size_t messages_per_turn_;
     std::thread messages_thread_;
-    std::condition_variable cv_;
-    std::mutex mutex_;
     std::atomic<bool> stop_messaging_loop_;
+    std::size_t message_workers_;
+    std::unique_ptr<ordered_dispatcher> dispatcher_;
     tls_options options_;
+    connection_options connection_options_;
+    wired::compression_stats compression_stats_;
+    accept_options accept_options_;
+    wired::accept_stats accept_stats_;
+    std::mutex accept_mutex_;
+    std::size_t pending_handshakes_;
+    // Accept loops waiting for a handshake slot
+    std::vector<std::function<void()>> paused_accepts_;
 }; // class server_interface
 
 template <typename T>
 server_interface<T>::server_interface()
-    : context_(), ssl_context_{asio::ssl::context::tls_server},
-      idle_work_(asio::make_work_guard(context_)), asio_thread_(),
-      acceptor_(context_), connections_(), messages_(), messages_thread_(),
-      cv_(), mutex_(), stop_messaging_loop_(false), options_() {
-    asio_thread_ =
-        std::thread(&server_interface<T>::contribute_to_context_pool, this);
-}
+    : handshake_pool_(nullptr), context_(), ssl_context_(), ticket_keys_(),
+      handshake_stats_(),
+      idle_work_(asio::make_work_guard(context_)), io_threads_(1),
+      asio_threads_(), acceptor_(context_),
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+      local_acceptor_(context_), local_path_(),
+#endif
+      connections_(), datagram_socket_(nullptr), datagram_mutex_(),
+      datagram_channels_(), ready_connections_(), messages_per_turn_(32),
+      messages_thread_(),
+      stop_messaging_loop_(false), message_workers_(0), dispatcher_(nullptr),
+      options_(), connection_options_(), compression_stats_(),
+      accept_options_(), accept_stats_(), accept_mutex_(),
+      pending_handshakes_(0), paused_accepts_() {}
 
 template <typename T>
 server_interface<T>::~server_interface() {
     WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                       "server_interface object [{}] destructor called",
                       static_cast<void*>(this));
-    if (asio_thread_.joinable()) {
-        asio_thread_.join();
+    // Without a shutdown the idle work would keep the io threads running
+    idle_work_.reset();
+    context_.stop();
+    for (auto& asio_thread : asio_threads_) {
+        if (asio_thread.joinable()) {
+            asio_thread.join();
+        }
+    }
+    if (handshake_pool_) {
+        handshake_pool_->stop();
     }
     stop_messaging_loop_ = true;
-    cv_.notify_all();
+    ready_connections_.wake();
     if (messages_thread_.joinable()) {
         messages_thread_.join();
     }
+    if (dispatcher_) {
+        dispatcher_->stop();
+    }
 }
 
 template <typename T>
 void server_interface<T>::start(const std::string& port) {
-    tls_options::set_context_options(ssl_context_, options_);
+    if (connection_options_.transport() == transport::tls) {
+        if (!ssl_context_) {
+            ssl_context_.emplace(asio::ssl::context::tls_server);
+        }
+        tls_options::set_context_options(*ssl_context_, options_);
+        if (options_.session_tickets() &&
+            options_.ticket_key_lifetime().count() > 0 &&
+            !ticket_keys_.attach(*ssl_context_,
+                                 options_.ticket_key_lifetime())) {
+            WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
+                              "Could not install rotating session ticket "
+                              "keys, using OpenSSL's ticket key");
+        }
+    }
     asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), std::stoi(port));
     acceptor_.open(endpoint.protocol());
     acceptor_.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+    // The window scale of accepted connections is settled during the
+    // handshake from the listener's receive buffer
+    std::size_t receive_buffer =
+        connection_options_.socket().receive_buffer_size();
+    if (receive_buffer > 0) {
+        acceptor_.set_option(asio::socket_base::receive_buffer_size(
+            static_cast<int>(receive_buffer)));
+    }
     acceptor_.bind(endpoint);
-    acceptor_.listen();
-    wait_for_client_chain();
+    acceptor_.listen(accept_options_.listen_backlog());
+    if (connection_options_.datagrams() &&
+        connection_options_.transport() == transport::tls) {
+        open_datagrams(endpoint);
+    }
+    wait_for_client_chain(acceptor_);
+    start_io_threads();
+}
+
+/**
+ * @brief Listen for datagrams on the udp port numbered like the tcp one
+ */
+template <typename T>
+void server_interface<T>::open_datagrams(
+    const asio::ip::tcp::endpoint& endpoint) {
+    asio::ip::udp::endpoint local(endpoint.address(), endpoint.port());
+    datagram_socket_ = std::make_shared<datagram_socket>(context_);
+    datagram_socket_->socket().open(local.protocol());
+    datagram_socket_->socket().bind(local);
+    datagram_socket_->start([this](std::vector<uint8_t>&& packet,
+                                   const asio::ip::udp::endpoint& from) {
+        route_datagram(std::move(packet), from);
+    });
+}
+
+template <typename T>
+void server_interface<T>::route_datagram(std::vector<uint8_t>&& packet,
+                                         const asio::ip::udp::endpoint& from) {
+    uint64_t channel = 0;
+    if (!datagram_session::peek_channel(packet, channel)) {
+        return;
+    }
+    connection_ptr conn;
+    {
+        std::lock_guard<std::mutex> lock(datagram_mutex_);
+        auto it = datagram_channels_.find(channel);
+        if (it == datagram_channels_.end()) {
+            return;
+        }
+        conn = it->second.lock();
+        if (!conn) {
+            datagram_channels_.erase(it);
+            return;
+        }
+    }
+    conn->receive_datagram(std::move(packet), from);
+}
+
+/**
+ * @brief Give a connection that completed its TLS handshake its end of
+ * the shared datagram socket
+ */
+template <typename T>
+void server_interface<T>::enable_datagrams(const connection_ptr& conn) {
+    if (!datagram_socket_ || !conn->stream().secure() ||
+        !conn->enable_datagrams(datagram_socket_, handshake_role::server)) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(datagram_mutex_);
+    datagram_channels_[conn->datagram_channel()] = conn;
+}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+/**
+ * @brief Listen on a unix domain socket instead of a tcp port
+ * endpoint is a filesystem path or, on Linux, an abstract name starting
+ * with a null byte. A stale socket file left at the path is replaced.
+ * Local connections are plaintext, only processes on this host that can
+ * reach the path may connect. With the shm transport the socket only sets
+ * up the shared memory rings that carry the messages.
+ */
+template <typename T>
+void server_interface<T>::start_local(
+    const asio::local::stream_protocol::endpoint& endpoint) {
+    std::string path = endpoint.path();
+    if (!path.empty() && path.front() != '\0') {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        local_path_ = path;
+    }
+    local_acceptor_.open(endpoint.protocol());
+    local_acceptor_.bind(endpoint);
+    local_acceptor_.listen(accept_options_.listen_backlog());
+    wait_for_client_chain(local_acceptor_);
+    start_io_threads();
+}
+#endif
+
+template <typename T>
+void server_interface<T>::start_io_threads() {
+    if (accept_options_.handshake_threads() > 0 && !handshake_pool_) {
+        handshake_pool_ = std::make_unique<io_context_pool>(
+            accept_options_.handshake_threads());
+    }
+    if (asio_threads_.empty()) {
+        WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                          "server_interface starting {} io threads",
+                          io_threads_);
+        for (std::size_t i = 0; i < io_threads_; ++i) {
+            asio_threads_.emplace_back(
+                &server_interface<T>::contribute_to_context_pool, this);
+        }
+    }
 }
 
 template <typename T>
@@ -122,17 +462,43 @@ void server_interface<T>::shutdown() {
     }
 
     stop_messaging_loop_ = true;
-    cv_.notify_all();
+    ready_connections_.wake();
     if (messages_thread_.joinable()) {
         messages_thread_.join();
     }
+    if (dispatcher_) {
+        dispatcher_->stop();
+    }
 
+    ready_connections_.clear();
     connections_.clear();
-    messages_.clear();
     acceptor_.close();
+    if (datagram_socket_) {
+        datagram_socket_->close();
+        datagram_socket_.reset();
+        std::lock_guard<std::mutex> lock(datagram_mutex_);
+        datagram_channels_.clear();
+    }
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    if (local_acceptor_.is_open()) {
+        local_acceptor_.close();
+        if (!local_path_.empty()) {
+            std::error_code ec;
+            std::filesystem::remove(local_path_, ec);
+            local_path_.clear();
+        }
+    }
+#endif
 
     context_.stop();
-    asio_thread_.join();
+    for (auto& asio_thread : asio_threads_) {
+        if (asio_thread.joinable()) {
+            asio_thread.join();
+        }
+    }
+    if (handshake_pool_) {
+        handshake_pool_->stop();
+    }
     idle_work_.reset();
     WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                       "server_interface shutdown completed");
@@ -140,6 +506,11 @@ void server_interface<T>::shutdown() {
 
 template <typename T>
 bool server_interface<T>::is_listening() {
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    if (local_acceptor_.is_open()) {
+        return true;
+    }
+#endif
     return acceptor_.is_open();
 }
 
@@ -155,20 +526,91 @@ std::future<bool> server_interface<T>::send(connection_ptr conn,
     return promise.get_future();
 }
 
+template <typename T>
+void server_interface<T>::send(connection_ptr conn, const message_t& msg,
+                               send_callback callback,
+                               message_strategy strategy) {
+    if (conn && conn->is_connected()) {
+        conn->send(msg, strategy, std::move(callback));
+    } else if (callback) {
+        callback(false);
+    }
+}
+
+template <typename T>
+void server_interface<T>::post(connection_ptr conn, const message_t& msg,
+                               message_strategy strategy) {
+    if (conn && conn->is_connected()) {
+        conn->post(msg, strategy);
+    }
+}
+
+template <typename T>
+std::future<bool>
+server_interface<T>::send_stream(connection_ptr conn, T id,
+                                 stream_source source, std::size_t chunk_size,
+                                 message_strategy strategy) {
+    if (conn && conn->is_connected()) {
+        return conn->send_stream(id, std::move(source), chunk_size, strategy);
+    }
+    std::promise<bool> promise;
+    promise.set_value(false);
+    return promise.get_future();
+}
+
+/**
+ * @brief Send a message to every connection except ignore
+ * The message is serialized once, every connection queues a reference to
+ * the same frame instead of its own copy
+ */
 template <typename T>
 std::vector<std::future<bool>>
 server_interface<T>::send_all(connection_ptr ignore, const message_t& msg,
                               message_strategy strategy) {
     std::vector<std::future<bool>> results;
+    auto frame = connection_t::make_frame(
+        msg, connection_options_.compression(), &compression_stats_);
     connections_.for_each(
-        [&results, &msg, &ignore, strategy](connection_ptr conn) {
+        [&results, &frame, &ignore, strategy](connection_ptr conn) {
             if (conn != ignore && conn->is_connected()) {
-                results.push_back(conn->send(msg, strategy));
+                results.push_back(conn->send(frame, strategy));
             }
         });
     return results;
 }
 
+template <typename T>
+void server_interface<T>::post_all(connection_ptr ignore, const message_t& msg,
+                                   message_strategy strategy) {
+    auto frame = connection_t::make_frame(
+        msg, connection_options_.compression(), &compression_stats_);
+    connections_.for_each([&frame, &ignore, strategy](connection_ptr conn) {
+        if (conn != ignore && conn->is_connected()) {
+            conn->post(frame, strategy);
+        }
+    });
+}
+
+/**
+ * @brief Send a message over conn's datagram channel, see
+ * connection::send_unreliable
+ */
+template <typename T>
+bool server_interface<T>::send_unreliable(connection_ptr conn,
+                                          const message_t& msg) {
+    return conn && conn->send_unreliable(msg);
+}
+
+template <typename T>
+void server_interface<T>::send_all_unreliable(connection_ptr ignore,
+                                              const message_t& msg) {
+    connections_.for_each([&msg, &ignore](connection_ptr conn) {
+        if (conn != ignore) {
+            conn->send_unreliable(msg);
+        }
+    });
+}
+
 template <typename T>
 std::future<bool> server_interface<T>::kick(connection_ptr conn) {
     if (conn && conn->is_connected()) {
@@ -184,6 +626,12 @@ std::future<bool> server_interface<T>::kick(connection_ptr conn) {
 
 template <typename T>
 void server_interface<T>::run(execution_policy policy) {
+    if (message_workers_ > 0 && !dispatcher_) {
+        WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                          "Server messages are dispatched on {} workers",
+                          message_workers_);
+        dispatcher_ = std::make_unique<ordered_dispatcher>(message_workers_);
+    }
     if (policy == execution_policy::blocking) {
         WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                           "Server message handler is running in blocking mode");
@@ -202,15 +650,21 @@ void server_interface<T>::run(execution_policy policy) {
     }
 }
 
+/**
+ * @brief Hand received messages to on_message, one connection at a time
+ * A connection gets at most messages_per_turn messages handled before it
+ * goes to the back of the line, so a flooding peer cannot delay everyone
+ * else. Its reads pause while its inbox is full.
+ */
 template <typename T>
 void server_interface<T>::messaging_loop() {
+    std::vector<message_t> batch;
+    batch.reserve(messages_per_turn_);
+    connection_ptr conn;
     while (is_listening()) {
-        std::unique_lock<std::mutex> lock(mutex_);
         WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
-                          "Waiting for messages in the queue");
-        cv_.wait(lock, [this] {
-            return (!messages_.empty() || stop_messaging_loop_);
-        });
+                          "Waiting for connections with messages");
+        ready_connections_.wait();
         if (stop_messaging_loop_) {
             WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                               "Stop messaging loop, exiting");
@@ -219,19 +673,59 @@ void server_interface<T>::messaging_loop() {
         WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
                           "Messages in the queue, processing them");
 
-        while (!messages_.empty()) {
-            if (stop_messaging_loop_) {
+        while (ready_connections_.try_pop(conn)) {
+            bool more = conn->take_turn(batch, messages_per_turn_);
+            for (auto& msg : batch) {
+                if (stop_messaging_loop_) {
+                    WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                                      "Stop messaging loop, exiting");
+                    return;
+                }
                 WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
-                                  "Stop messaging loop, exiting");
-                return;
+                                  "Processing message with id {}",
+                                  static_cast<uint32_t>(msg.head().id()));
+                if (dispatcher_) {
+                    // Read before the task below moves msg away
+                    const std::size_t key = ordering_key(msg);
+                    dispatcher_->submit(
+                        key, [this, msg = std::move(msg)]() mutable {
+                            deliver(msg);
+                        });
+                } else {
+                    deliver(msg);
+                }
             }
-            message_t msg = messages_.front();
-            messages_.pop_front();
-            WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
-                              "Processing message with id {}",
-                              static_cast<uint32_t>(msg.head().id()));
+            batch.clear();
+            if (more) {
+                ready_connections_.push(std::move(conn));
+            }
+            conn.reset();
+        }
+    }
+}
+
+/**
+ * @brief Hand msg to on_message or on_chunk
+ * A throwing handler is logged and the next message is handled, whether
+ * it ran on the messaging loop or on a dispatcher worker.
+ */
+template <typename T>
+void server_interface<T>::deliver(message_t& msg) {
+    try {
+        if (msg.head().is_chunk()) {
+            on_chunk(msg, msg.from());
+        } else {
             on_message(msg, msg.from());
         }
+    } catch (const std::exception& e) {
+        WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
+                          "Handler of message with id {} threw: {}",
+                          static_cast<uint32_t>(msg.head().id()), e.what());
+    } catch (...) {
+        WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
+                          "Handler of message with id {} threw a non "
+                          "standard exception",
+                          static_cast<uint32_t>(msg.head().id()));
     }
 }
 
@@ -241,50 +735,235 @@ void server_interface<T>::contribute_to_context_pool() {
 }
 
 template <typename T>
-void server_interface<T>::wait_for_client_chain() {
-    acceptor_.async_accept(
-        [this](std::error_code ec, asio::ip::tcp::socket socket) {
-            if (!ec) {
-                connection_ptr conn = std::make_shared<connection_t>(
-                    context_, ssl_context_, std::move(socket), messages_, cv_);
+typename server_interface<T>::connection_ptr
+server_interface<T>::make_connection(asio::ip::tcp::socket&& socket) {
+    const connection_options& options = connection_options_;
+    if (options.transport() == transport::tls) {
+        return attach(std::make_shared<connection_t>(
+            context_, *ssl_context_, std::move(socket), options));
+    }
+    return attach(
+        std::make_shared<connection_t>(context_, std::move(socket), options));
+}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+template <typename T>
+typename server_interface<T>::connection_ptr
+server_interface<T>::make_connection(
+    asio::local::stream_protocol::socket&& socket) {
+    return attach(std::make_shared<connection_t>(
+        context_, std::move(socket), connection_options_));
+}
+#endif
+
+/**
+ * @brief Queue the new connection for the messaging loop whenever its
+ * inbox receives messages and forward its drain notifications to
+ * on_writable
+ */
+template <typename T>
+typename server_interface<T>::connection_ptr
+server_interface<T>::attach(connection_ptr conn) {
+    std::weak_ptr<connection_t> weak = conn;
+    conn->set_inbox_handler([this, weak]() {
+        if (auto conn = weak.lock()) {
+            ready_connections_.push(std::move(conn));
+        }
+    });
+    conn->set_drain_handler([this, weak]() {
+        if (auto conn = weak.lock()) {
+            on_writable(conn);
+        }
+    });
+    return conn;
+}
+
+/**
+ * @brief Accept connections and start their handshakes
+ * The next accept is issued right away unless max_pending_handshakes are in
+ * flight, then it waits for one of them to finish. A failed accept or
+ * handshake never stops the loop, only closing the acceptor does.
+ */
+template <typename T>
+template <typename Acceptor>
+void server_interface<T>::wait_for_client_chain(Acceptor& acceptor) {
+    acceptor.async_accept(
+        [this, &acceptor](const asio::error_code& ec,
+                          typename Acceptor::protocol_type::socket socket) {
+            if (ec == asio::error::operation_aborted || !acceptor.is_open()) {
                 WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
-                                  "wait_for_client_chain successfully accepted "
-                                  "a connection, obj addr {}",
-                                  static_cast<void*>(conn.get()));
-                conn->ssl_stream().async_handshake(
-                    asio::ssl::stream_base::server,
-                    [this, conn](const asio::error_code& handshake_error) {
-                        if (!handshake_error) {
-                            WIRED_LOG_MESSAGE(log_level::LOG_INFO,
-                                              "SSL handshake successful for "
-                                              "connection obj addr {}",
-                                              static_cast<void*>(conn.get()));
-                            if (conn->is_connected()) {
-                                conn->start_listening();
-                                connections_.push_back(conn);
-                            }
-                            wait_for_client_chain();
-                        } else {
-                            WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
-                                              "SSL handshake failed for "
-                                              "connection obj addr {} with "
-                                              "error code: {} and error "
-                                              "message: {}",
-                                              static_cast<void*>(conn.get()),
-                                              handshake_error.value(),
-                                              handshake_error.message());
-                        }
-                    });
-            } else {
+                                  "wait_for_client_chain stopped accepting");
+                return;
+            }
+            if (ec) {
+                accept_stats_.record_accept_error();
                 WIRED_LOG_MESSAGE(
                     log_level::LOG_DEBUG,
                     "wait_for_client_chain didn't succeed to accept a "
                     "connection with error code: {} and error message: {}",
                     ec.value(), ec.message());
+                if (is_exhaustion_error(ec)) {
+                    retry_accept(acceptor);
+                } else {
+                    wait_for_client_chain(acceptor);
+                }
+                return;
             }
+
+            accept_stats_.record_accept();
+            connection_ptr conn = make_connection(std::move(socket));
+            WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                              "wait_for_client_chain successfully accepted "
+                              "a connection, obj addr {}",
+                              static_cast<void*>(conn.get()));
+            bool paused = false;
+            {
+                std::lock_guard<std::mutex> lock(accept_mutex_);
+                accept_stats_.set_pending_handshakes(++pending_handshakes_);
+                if (pending_handshakes_ >=
+                    accept_options_.max_pending_handshakes()) {
+                    paused_accepts_.push_back([this, &acceptor]() {
+                        wait_for_client_chain(acceptor);
+                    });
+                    paused = true;
+                }
+            }
+            handshake(conn);
+            if (paused) {
+                WIRED_LOG_MESSAGE(log_level::LOG_DEBUG,
+                                  "wait_for_client_chain paused, {} "
+                                  "handshakes in flight",
+                                  accept_options_.max_pending_handshakes());
+                return;
+            }
+            wait_for_client_chain(acceptor);
         });
 }
 
+/**
+ * @brief Accept again after accept_retry_delay
+ * The pending connection that failed stays queued, accepting again at once
+ * would fail the same way and spin an io thread until descriptors or
+ * memory free up.
+ */
+template <typename T>
+template <typename Acceptor>
+void server_interface<T>::retry_accept(Acceptor& acceptor) {
+    auto timer = std::make_shared<asio::steady_timer>(context_);
+    timer->expires_after(accept_options_.accept_retry_delay());
+    timer->async_wait([this, &acceptor, timer](const asio::error_code& error) {
+        if (!error && acceptor.is_open()) {
+            wait_for_client_chain(acceptor);
+        }
+    });
+}
+
+template <typename T>
+bool server_interface<T>::is_exhaustion_error(const asio::error_code& error) {
+    return error == asio::error::no_descriptors ||
+           error == asio::error::no_buffer_space ||
+           error == asio::error::no_memory ||
+           error == asio::error_code(ENFILE,
+                                     asio::error::get_system_category());
+}
+
+/**
+ * @brief Run the server side handshake of an accepted connection under the
+ * handshake deadline
+ * With handshake threads the handshake runs on a strand of the handshake
+ * pool, the socket stays on the io threads which only complete its reads
+ * and writes while the TLS work runs on the pool. The result is handed
+ * back to the connection's strand.
+ */
+template <typename T>
+void server_interface<T>::handshake(connection_ptr conn) {
+    using strand_t = typename connection_t::strand_t;
+    strand_t executor = handshake_pool_
+                            ? asio::make_strand(handshake_pool_->next())
+                            : conn->strand();
+    asio::dispatch(executor, [this, conn, executor]() {
+        auto timer = std::make_shared<asio::steady_timer>(context_);
+        auto timed_out = std::make_shared<bool>(false);
+        if (accept_options_.handshake_timeout().count() > 0) {
+            timer->expires_after(accept_options_.handshake_timeout());
+            timer->async_wait(asio::bind_executor(
+                executor, [conn, timed_out](const asio::error_code& error) {
+                    if (error) {
+                        return;
+                    }
+                    *timed_out = true;
+                    asio::error_code ignored;
+                    conn->stream().close(ignored);
+                }));
+        }
+
+        conn->stream().async_handshake(
+            handshake_role::server,
+            asio::bind_executor(
+                executor, [this, conn, timer, timed_out](
+                              const asio::error_code& handshake_error) {
+                    timer->cancel();
+                    asio::dispatch(conn->strand(), [this, conn,
+                                                    handshake_error,
+                                                    timed_out]() {
+                        complete_handshake(conn, handshake_error, *timed_out);
+                    });
+                }));
+    });
+}
+
+/**
+ * @brief Register a connection that completed its handshake, runs on the
+ * connection's strand
+ */
+template <typename T>
+void server_interface<T>::complete_handshake(connection_ptr conn,
+                                             const asio::error_code& error,
+                                             bool timed_out) {
+    bool completed = !error && conn->is_connected();
+    accept_stats_.record_handshake(completed, timed_out);
+    if (completed) {
+        WIRED_LOG_MESSAGE(log_level::LOG_INFO,
+                          "Handshake successful for connection obj addr {}",
+                          static_cast<void*>(conn.get()));
+        if (conn->stream().secure()) {
+            handshake_stats_.record(
+                SSL_session_reused(conn->ssl_stream().native_handle()) == 1);
+        }
+        enable_datagrams(conn);
+        connections_.push_back(conn);
+        conn->start_listening();
+    } else {
+        WIRED_LOG_MESSAGE(log_level::LOG_ERROR,
+                          "Handshake {} for connection obj addr {} with "
+                          "error code: {} and error message: {}",
+                          timed_out ? "timed out" : "failed",
+                          static_cast<void*>(conn.get()), error.value(),
+                          error.message());
+        asio::error_code ignored;
+        conn->stream().close(ignored);
+    }
+    finish_handshake();
+}
+
+/**
+ * @brief Release a handshake slot and resume accept loops waiting for one
+ */
+template <typename T>
+void server_interface<T>::finish_handshake() {
+    std::vector<std::function<void()>> resume;
+    {
+        std::lock_guard<std::mutex> lock(accept_mutex_);
+        accept_stats_.set_pending_handshakes(--pending_handshakes_);
+        if (pending_handshakes_ < accept_options_.max_pending_handshakes()) {
+            resume.swap(paused_accepts_);
+        }
+    }
+    for (auto& accept : resume) {
+        accept();
+    }
+}
+
 } // namespace wired
 
 #endif // WIRED_SERVER_H
\ No newline at end of file
@@ -0,0 +1,722 @@
+#ifndef WIRED_SHM_STREAM_H
+#define WIRED_SHM_STREAM_H
+
+#include <asio.hpp>
+
+#include "wired/types.h"
+
+#if defined(__linux__) && defined(ASIO_HAS_LOCAL_SOCKETS)
+#define WIRED_HAS_SHM_TRANSPORT 1
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace wired {
+
+/**
+ * @brief Shared control block of one shm ring
+ * head and tail count every byte ever read and written, the flags tell the
+ * other side that a wakeup is needed. Each field has its own cache line so
+ * producer and consumer never write to the same line.
+ */
+struct shm_ring_control {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> consumer_waiting;
+    alignas(64) std::atomic<uint32_t> producer_waiting;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "shm rings need lock free atomics to be shared by processes");
+
+/**
+ * @brief Single producer single consumer byte ring in shared memory
+ * A view over memory owned by a shm_channel, capacity is a power of two.
+ * The peer process can write the control block, indices that run backwards
+ * or further apart than the capacity mark the ring corrupted for good.
+ */
+class shm_ring {
+  public:
+    shm_ring()
+        : control_(nullptr), data_(nullptr), capacity_(0), head_(0), tail_(0),
+          corrupted_(false) {}
+    shm_ring(shm_ring_control* control, uint8_t* data, std::size_t capacity)
+        : control_(control), data_(data), capacity_(capacity), head_(0),
+          tail_(0), corrupted_(false) {}
+
+    template <typename ConstBuffers>
+    std::size_t write(const ConstBuffers& buffers, asio::error_code& error);
+    template <typename MutableBuffers>
+    std::size_t read(const MutableBuffers& buffers, asio::error_code& error);
+
+    std::size_t readable() {
+        return load_indices() ? static_cast<std::size_t>(tail_ - head_) : 0;
+    }
+    std::size_t writable() {
+        return load_indices()
+                   ? capacity_ - static_cast<std::size_t>(tail_ - head_)
+                   : 0;
+    }
+    bool corrupted() const { return corrupted_; }
+    shm_ring_control& control() { return *control_; }
+
+  private:
+    bool load_indices();
+
+  private:
+    shm_ring_control* control_;
+    uint8_t* data_;
+    std::size_t capacity_;
+    uint64_t head_; // Last indices seen, they never run backwards
+    uint64_t tail_;
+    bool corrupted_;
+}; // class shm_ring
+
+/**
+ * @brief Load both indices once and check them against the last ones seen
+ *
+ * @return false when the ring is corrupted
+ */
+inline bool shm_ring::load_indices() {
+    if (corrupted_) {
+        return false;
+    }
+    uint64_t head = control_->head.load(std::memory_order_acquire);
+    uint64_t tail = control_->tail.load(std::memory_order_acquire);
+    if (head < head_ || tail < tail_ || tail - head > capacity_) {
+        corrupted_ = true;
+        return false;
+    }
+    head_ = head;
+    tail_ = tail;
+    return true;
+}
+
+/**
+ * @brief Copy as much of buffers as fits, publishes it with one store
+ */
+template <typename ConstBuffers>
+std::size_t shm_ring::write(const ConstBuffers& buffers,
+                            asio::error_code& error) {
+    std::size_t space = writable();
+    if (corrupted_) {
+        error = asio::error::invalid_argument;
+        return 0;
+    }
+    uint64_t tail = tail_;
+    std::size_t written = 0;
+    for (auto it = asio::buffer_sequence_begin(buffers);
+         it != asio::buffer_sequence_end(buffers) && written < space; ++it) {
+        asio::const_buffer buffer(*it);
+        const uint8_t* src = static_cast<const uint8_t*>(buffer.data());
+        std::size_t bytes = std::min(buffer.size(), space - written);
+        std::size_t offset = (tail + written) & (capacity_ - 1);
+        std::size_t first = std::min(bytes, capacity_ - offset);
+        std::memcpy(data_ + offset, src, first);
+        std::memcpy(data_, src + first, bytes - first);
+        written += bytes;
+    }
+    if (written > 0) {
+        tail_ = tail + written;
+        control_->tail.store(tail_, std::memory_order_release);
+    }
+    error = asio::error_code();
+    return written;
+}
+
+/**
+ * @brief Copy as many readable bytes as buffers hold, frees them with one
+ * store
+ */
+template <typename MutableBuffers>
+std::size_t shm_ring::read(const MutableBuffers& buffers,
+                           asio::error_code& error) {
+    std::size_t available = readable();
+    if (corrupted_) {
+        error = asio::error::invalid_argument;
+        return 0;
+    }
+    uint64_t head = head_;
+    std::size_t bytes_read = 0;
+    for (auto it = asio::buffer_sequence_begin(buffers);
+         it != asio::buffer_sequence_end(buffers) && bytes_read < available;
+         ++it) {
+        asio::mutable_buffer buffer(*it);
+        uint8_t* dst = static_cast<uint8_t*>(buffer.data());
+        std::size_t bytes = std::min(buffer.size(), available - bytes_read);
+        std::size_t offset = (head + bytes_read) & (capacity_ - 1);
+        std::size_t first = std::min(bytes, capacity_ - offset);
+        std::memcpy(dst, data_ + offset, first);
+        std::memcpy(dst + first, data_, bytes - first);
+        bytes_read += bytes;
+    }
+    if (bytes_read > 0) {
+        head_ = head + bytes_read;
+        control_->head.store(head_, std::memory_order_release);
+    }
+    error = asio::error_code();
+    return bytes_read;
+}
+
+/**
+ * @brief A memfd holding two shm rings and the eventfds that wake their
+ * consumers and producers
+ * Ring 0 carries server to client bytes and ring 1 client to server bytes.
+ * Event 2 * i wakes the consumer of ring i and event 2 * i + 1 its
+ * producer. The server creates the channel and passes every descriptor to
+ * the client over the unix domain socket it accepted.
+ */
+class shm_channel {
+  public:
+    static constexpr std::size_t event_count = 4;
+
+  public:
+    shm_channel() : memory_(nullptr), size_(0), ring_size_(0), fds_() {
+        fds_.fill(-1);
+    }
+    shm_channel(const shm_channel& other) = delete;
+    shm_channel(shm_channel&& other) noexcept
+        : memory_(std::exchange(other.memory_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          ring_size_(std::exchange(other.ring_size_, 0)), fds_(other.fds_) {
+        other.fds_.fill(-1);
+    }
+    ~shm_channel() { release(); }
+
+    shm_channel& operator=(const shm_channel& other) = delete;
+    shm_channel& operator=(shm_channel&& other) noexcept {
+        if (this != &other) {
+            release();
+            memory_ = std::exchange(other.memory_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            ring_size_ = std::exchange(other.ring_size_, 0);
+            fds_ = other.fds_;
+            other.fds_.fill(-1);
+        }
+        return *this;
+    }
+
+    static shm_channel create(std::size_t ring_size, asio::error_code& error);
+    static shm_channel receive(int socket, asio::error_code& error);
+    void send(int socket, asio::error_code& error) const;
+
+    shm_ring ring(std::size_t index) const {
+        auto* base = static_cast<uint8_t*>(memory_);
+        return shm_ring(reinterpret_cast<shm_ring_control*>(
+                            base + sizeof(header) +
+                            index * sizeof(shm_ring_control)),
+                        base + data_offset_ + index * ring_size_, ring_size_);
+    }
+    int event(std::size_t index) const { return fds_[1 + index]; }
+
+  private:
+    struct alignas(64) header {
+        uint64_t magic;
+        uint64_t ring_size;
+    };
+
+    static constexpr uint64_t magic_ = 0x3130'4d48'5344'5257; // "WRDSHM01"
+    static constexpr std::size_t data_offset_ =
+        sizeof(header) + 2 * sizeof(shm_ring_control);
+
+    static asio::error_code last_error() {
+        return asio::error_code(errno, asio::error::get_system_category());
+    }
+
+    static void close_received(msghdr& message);
+    bool map(std::size_t size, asio::error_code& error);
+    void release();
+
+  private:
+    void* memory_;
+    std::size_t size_;
+    std::size_t ring_size_;
+    // The memfd followed by the eventfds
+    std::array<int, 1 + event_count> fds_;
+}; // class shm_channel
+
+inline shm_channel shm_channel::create(std::size_t ring_size,
+                                       asio::error_code& error) {
+    shm_channel channel;
+    channel.ring_size_ = ring_size;
+    channel.fds_[0] = ::memfd_create("wired-shm", MFD_CLOEXEC);
+    if (channel.fds_[0] < 0) {
+        error = last_error();
+        return channel;
+    }
+    std::size_t size = data_offset_ + 2 * ring_size;
+    if (::ftruncate(channel.fds_[0], static_cast<off_t>(size)) != 0 ||
+        !channel.map(size, error)) {
+        error = error ? error : last_error();
+        return channel;
+    }
+    for (std::size_t i = 1; i <= event_count; ++i) {
+        channel.fds_[i] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (channel.fds_[i] < 0) {
+            error = last_error();
+            return channel;
+        }
+    }
+
+    new (channel.memory_) header{magic_, ring_size};
+    for (std::size_t i = 0; i < 2; ++i) {
+        auto* control = static_cast<uint8_t*>(channel.memory_) +
+                        sizeof(header) + i * sizeof(shm_ring_control);
+        new (control) shm_ring_control{{0}, {0}, {0}, {0}};
+    }
+    error = asio::error_code();
+    return channel;
+}
+
+/**
+ * @brief Take over a channel sent by the peer, validating its layout
+ */
+inline shm_channel shm_channel::receive(int socket, asio::error_code& error) {
+    shm_channel channel;
+    char payload = 0;
+    iovec iov{&payload, sizeof(payload)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * (1 + event_count))];
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t received = ::recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+        error = last_error();
+        return channel;
+    }
+    if (received == 0) {
+        error = asio::error::eof;
+        return channel;
+    }
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    if ((message.msg_flags & MSG_CTRUNC) || !cmsg ||
+        cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int) * (1 + event_count))) {
+        close_received(message);
+        error = asio::error::invalid_argument;
+        return channel;
+    }
+    std::memcpy(channel.fds_.data(), CMSG_DATA(cmsg),
+                sizeof(int) * (1 + event_count));
+
+    struct stat info;
+    if (::fstat(channel.fds_[0], &info) != 0) {
+        error = last_error();
+        return channel;
+    }
+    std::size_t size = static_cast<std::size_t>(info.st_size);
+    if (size < data_offset_ || !channel.map(size, error)) {
+        error = error ? error : asio::error::invalid_argument;
+        return channel;
+    }
+    const auto* head = static_cast<const header*>(channel.memory_);
+    if (head->magic != magic_ || head->ring_size == 0 ||
+        (head->ring_size & (head->ring_size - 1)) != 0 ||
+        size != data_offset_ + 2 * head->ring_size) {
+        error = asio::error::invalid_argument;
+        return channel;
+    }
+    channel.ring_size_ = head->ring_size;
+    error = asio::error_code();
+    return channel;
+}
+
+/**
+ * @brief Close every descriptor the kernel installed from a message that
+ * is rejected, the channel only owns them once they are validated
+ */
+inline void shm_channel::close_received(msghdr& message) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg;
+         cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+            cmsg->cmsg_len < CMSG_LEN(0)) {
+            continue;
+        }
+        std::size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const unsigned char* data = CMSG_DATA(cmsg);
+        for (std::size_t i = 0; i < count; ++i) {
+            int fd;
+            std::memcpy(&fd, data + i * sizeof(int), sizeof(int));
+            ::close(fd);
+        }
+    }
+}
+
+inline void shm_channel::send(int socket, asio::error_code& error) const {
+    char payload = 0;
+    iovec iov{&payload, sizeof(payload)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * (1 + event_count))];
+    std::memset(control, 0, sizeof(control));
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * (1 + event_count));
+    std::memcpy(CMSG_DATA(cmsg), fds_.data(), sizeof(int) * (1 + event_count));
+
+    if (::sendmsg(socket, &message, MSG_NOSIGNAL) < 0) {
+        error = last_error();
+        return;
+    }
+    error = asio::error_code();
+}
+
+inline bool shm_channel::map(std::size_t size, asio::error_code& error) {
+    void* memory = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          fds_[0], 0);
+    if (memory == MAP_FAILED) {
+        error = last_error();
+        return false;
+    }
+    memory_ = memory;
+    size_ = size;
+    return true;
+}
+
+inline void shm_channel::release() {
+    if (memory_) {
+        ::munmap(memory_, size_);
+        memory_ = nullptr;
+    }
+    for (int& fd : fds_) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+/**
+ * @brief Byte stream over a pair of shm rings, bootstrapped over a unix
+ * domain socket
+ * Reads and writes are plain copies into shared memory. A side only sleeps
+ * on its eventfd when its ring is empty (or full) and the other side only
+ * pays for a write to that eventfd when it sees the sleeping flag, so a
+ * busy stream runs without any syscall. With busy polling an empty ring is
+ * retried on the executor instead, trading a core for latency.
+ *
+ * The socket stays open as a liveness signal, the peer closing it or dying
+ * ends the stream once the remaining bytes are read. All operations of a
+ * stream must run on one strand.
+ */
+class shm_stream {
+  public:
+    using socket_t = asio::local::stream_protocol::socket;
+    using executor_type = socket_t::executor_type;
+    using lowest_layer_type = shm_stream;
+
+  public:
+    shm_stream(socket_t&& socket, std::size_t ring_size, bool busy_poll)
+        : socket_(std::move(socket)), ring_size_(ring_size),
+          busy_poll_(busy_poll), channel_(), rx_(), tx_(),
+          rx_data_(socket_.get_executor()), tx_space_(socket_.get_executor()),
+          rx_data_fd_(-1), tx_space_fd_(-1), tx_data_fd_(-1),
+          rx_space_fd_(-1), peer_closed_(false) {}
+    shm_stream(const shm_stream& other) = delete;
+    // Only valid before the handshake
+    shm_stream(shm_stream&& other)
+        : socket_(std::move(other.socket_)), ring_size_(other.ring_size_),
+          busy_poll_(other.busy_poll_), channel_(), rx_(), tx_(),
+          rx_data_(socket_.get_executor()), tx_space_(socket_.get_executor()),
+          rx_data_fd_(-1), tx_space_fd_(-1), tx_data_fd_(-1),
+          rx_space_fd_(-1), peer_closed_(false) {}
+
+    shm_stream& operator=(const shm_stream& other) = delete;
+
+    socket_t& socket() { return socket_; }
+    lowest_layer_type& lowest_layer() { return *this; }
+    const lowest_layer_type& lowest_layer() const { return *this; }
+    executor_type get_executor() { return socket_.get_executor(); }
+    bool is_open() const { return socket_.is_open(); }
+    void shutdown(asio::socket_base::shutdown_type what,
+                  asio::error_code& error) {
+        socket_.shutdown(what, error);
+    }
+    void close(asio::error_code& error);
+
+    template <typename Handler>
+    void async_handshake(handshake_role role, Handler&& handler);
+    template <typename MutableBuffers, typename Handler>
+    void async_read_some(const MutableBuffers& buffers, Handler&& handler);
+    template <typename ConstBuffers, typename Handler>
+    void async_write_some(const ConstBuffers& buffers, Handler&& handler);
+
+  private:
+    void attach(shm_channel&& channel, handshake_role role);
+    void watch_peer();
+
+    template <typename Handler, typename... Args>
+    void complete(Handler&& handler, Args... args);
+    template <typename Executor, typename Ready, typename Retry>
+    void wait_for(std::atomic<uint32_t>& waiting,
+                  asio::posix::stream_descriptor& event, Executor executor,
+                  Ready ready, Retry&& retry);
+
+    static void signal(int fd) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = ::write(fd, &one, sizeof(one));
+    }
+    static void drain(int fd) {
+        uint64_t count;
+        [[maybe_unused]] ssize_t bytes = ::read(fd, &count, sizeof(count));
+    }
+
+  private:
+    socket_t socket_;
+    std::size_t ring_size_;
+    bool busy_poll_;
+    shm_channel channel_;
+    shm_ring rx_;
+    shm_ring tx_;
+    asio::posix::stream_descriptor rx_data_;  // Wakes us to read
+    asio::posix::stream_descriptor tx_space_; // Wakes us to write
+    int rx_data_fd_;
+    int tx_space_fd_;
+    int tx_data_fd_;  // Wakes the peer to read
+    int rx_space_fd_; // Wakes the peer to write
+    std::atomic<bool> peer_closed_;
+}; // class shm_stream
+
+/**
+ * @brief The server creates and sends the channel, the client waits for it
+ */
+template <typename Handler>
+void shm_stream::async_handshake(handshake_role role, Handler&& handler) {
+    if (role == handshake_role::server) {
+        asio::error_code error;
+        shm_channel channel = shm_channel::create(ring_size_, error);
+        if (!error) {
+            channel.send(socket_.native_handle(), error);
+        }
+        if (!error) {
+            attach(std::move(channel), role);
+        }
+        complete(std::forward<Handler>(handler), error);
+        return;
+    }
+
+    auto executor = asio::get_associated_executor(handler, get_executor());
+    socket_.async_wait(
+        asio::socket_base::wait_read,
+        asio::bind_executor(
+            executor, [this, role, handler = std::forward<Handler>(handler)](
+                          asio::error_code error) mutable {
+                if (!error) {
+                    shm_channel channel =
+                        shm_channel::receive(socket_.native_handle(), error);
+                    if (!error) {
+                        attach(std::move(channel), role);
+                    }
+                }
+                handler(error);
+            }));
+}
+
+template <typename MutableBuffers, typename Handler>
+void shm_stream::async_read_some(const MutableBuffers& buffers,
+                                 Handler&& handler) {
+    if (!socket_.is_open()) {
+        complete(std::forward<Handler>(handler),
+                 asio::error::operation_aborted, 0);
+        return;
+    }
+    if (asio::buffer_size(buffers) == 0) {
+        complete(std::forward<Handler>(handler), asio::error_code(), 0);
+        return;
+    }
+    asio::error_code error;
+    std::size_t bytes = rx_.read(buffers, error);
+    if (error) {
+        complete(std::forward<Handler>(handler), error, 0);
+        return;
+    }
+    if (bytes > 0) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (rx_.control().producer_waiting.load(std::memory_order_relaxed)) {
+            signal(rx_space_fd_);
+        }
+        complete(std::forward<Handler>(handler), asio::error_code(), bytes);
+        return;
+    }
+    if (peer_closed_.load(std::memory_order_acquire)) {
+        complete(std::forward<Handler>(handler), asio::error::eof, 0);
+        return;
+    }
+
+    auto executor = asio::get_associated_executor(handler, get_executor());
+    wait_for(rx_.control().consumer_waiting, rx_data_, executor,
+             [this]() {
+                 return rx_.readable() > 0 || rx_.corrupted() ||
+                        peer_closed_.load(std::memory_order_acquire);
+             },
+             [this, buffers, handler = std::forward<Handler>(handler)](
+                 const asio::error_code& error) mutable {
+                 if (error) {
+                     complete(std::move(handler), error, 0);
+                 } else {
+                     async_read_some(buffers, std::move(handler));
+                 }
+             });
+}
+
+template <typename ConstBuffers, typename Handler>
+void shm_stream::async_write_some(const ConstBuffers& buffers,
+                                  Handler&& handler) {
+    if (!socket_.is_open()) {
+        complete(std::forward<Handler>(handler),
+                 asio::error::operation_aborted, 0);
+        return;
+    }
+    if (peer_closed_.load(std::memory_order_acquire)) {
+        complete(std::forward<Handler>(handler), asio::error::broken_pipe, 0);
+        return;
+    }
+    if (asio::buffer_size(buffers) == 0) {
+        complete(std::forward<Handler>(handler), asio::error_code(), 0);
+        return;
+    }
+    asio::error_code error;
+    std::size_t bytes = tx_.write(buffers, error);
+    if (error) {
+        complete(std::forward<Handler>(handler), error, 0);
+        return;
+    }
+    if (bytes > 0) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (tx_.control().consumer_waiting.load(std::memory_order_relaxed)) {
+            signal(tx_data_fd_);
+        }
+        complete(std::forward<Handler>(handler), asio::error_code(), bytes);
+        return;
+    }
+
+    auto executor = asio::get_associated_executor(handler, get_executor());
+    wait_for(tx_.control().producer_waiting, tx_space_, executor,
+             [this]() {
+                 return tx_.writable() > 0 || tx_.corrupted() ||
+                        peer_closed_.load(std::memory_order_acquire);
+             },
+             [this, buffers, handler = std::forward<Handler>(handler)](
+                 const asio::error_code& error) mutable {
+                 if (error) {
+                     complete(std::move(handler), error, 0);
+                 } else {
+                     async_write_some(buffers, std::move(handler));
+                 }
+             });
+}
+
+inline void shm_stream::close(asio::error_code& error) {
+    asio::error_code ignored;
+    rx_data_.close(ignored);
+    tx_space_.close(ignored);
+    socket_.close(error);
+}
+
+inline void shm_stream::attach(shm_channel&& channel, handshake_role role) {
+    channel_ = std::move(channel);
+    std::size_t rx = role == handshake_role::server ? 1 : 0;
+    std::size_t tx = 1 - rx;
+    rx_ = channel_.ring(rx);
+    tx_ = channel_.ring(tx);
+    rx_data_fd_ = channel_.event(2 * rx);
+    rx_space_fd_ = channel_.event(2 * rx + 1);
+    tx_data_fd_ = channel_.event(2 * tx);
+    tx_space_fd_ = channel_.event(2 * tx + 1);
+    // The descriptors own their copies, the channel keeps the originals
+    rx_data_.assign(::dup(rx_data_fd_));
+    tx_space_.assign(::dup(tx_space_fd_));
+    watch_peer();
+}
+
+/**
+ * @brief Nothing is ever read from the socket after the handshake, so it
+ * turns readable exactly when the peer closes it
+ */
+inline void shm_stream::watch_peer() {
+    socket_.async_wait(asio::socket_base::wait_read,
+                       [this](const asio::error_code& error) {
+                           if (error == asio::error::operation_aborted) {
+                               return;
+                           }
+                           peer_closed_.store(true, std::memory_order_release);
+                           signal(rx_data_fd_);
+                           signal(tx_space_fd_);
+                       });
+}
+
+/**
+ * @brief Invoke handler with args through its executor, never inline
+ */
+template <typename Handler, typename... Args>
+void shm_stream::complete(Handler&& handler, Args... args) {
+    auto executor = asio::get_associated_executor(handler, get_executor());
+    asio::post(executor, [handler = std::forward<Handler>(handler),
+                          args...]() mutable { handler(args...); });
+}
+
+/**
+ * @brief Call retry once ready may have turned true
+ * Raises the waiting flag before checking ready one last time, so the other
+ * side either sees the flag and signals the event or made ready true
+ * before the check.
+ */
+template <typename Executor, typename Ready, typename Retry>
+void shm_stream::wait_for(std::atomic<uint32_t>& waiting,
+                          asio::posix::stream_descriptor& event,
+                          Executor executor, Ready ready, Retry&& retry) {
+    if (busy_poll_) {
+        asio::post(executor, [retry = std::forward<Retry>(retry)]() mutable {
+            retry(asio::error_code());
+        });
+        return;
+    }
+    waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ready()) {
+        waiting.store(0, std::memory_order_relaxed);
+        asio::post(executor, [retry = std::forward<Retry>(retry)]() mutable {
+            retry(asio::error_code());
+        });
+        return;
+    }
+    event.async_wait(
+        asio::posix::stream_descriptor::wait_read,
+        asio::bind_executor(
+            executor, [&waiting, &event, retry = std::forward<Retry>(retry)](
+                          const asio::error_code& error) mutable {
+                if (!error) {
+                    waiting.store(0, std::memory_order_relaxed);
+                    drain(event.native_handle());
+                }
+                retry(error);
+            }));
+}
+
+} // namespace wired
+
+#endif // defined(__linux__) && defined(ASIO_HAS_LOCAL_SOCKETS)
+
+#endif // WIRED_SHM_STREAM_H
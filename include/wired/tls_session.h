@@ -0,0 +1,394 @@
+#ifndef WIRED_TLS_SESSION_H
+#define WIRED_TLS_SESSION_H
+
+#include <asio/ssl.hpp>
+
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+namespace wired {
+
+/**
+ * @brief Counts of full and resumed TLS handshakes
+ */
+class tls_handshake_stats {
+  public:
+    tls_handshake_stats() : full_(0), resumed_(0) {}
+
+    void record(bool resumed) {
+        (resumed ? resumed_ : full_).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint64_t full_handshakes() const {
+        return full_.load(std::memory_order_relaxed);
+    }
+    uint64_t resumed_handshakes() const {
+        return resumed_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<uint64_t> full_;
+    std::atomic<uint64_t> resumed_;
+}; // class tls_handshake_stats
+
+/**
+ * @brief Client side cache of TLS sessions, one per host and port
+ * Attached to a client ssl context, it stores the sessions and tickets the
+ * server hands out and offers the one of the same host and port on the
+ * next connection, which then completes with an abbreviated handshake. A
+ * session is offered until the server hands out a newer one. A full cache
+ * evicts the session of the host and port used least recently.
+ */
+class tls_session_cache {
+  public:
+    tls_session_cache()
+        : mutex_(), lru_(), sessions_(), capacity_(0), stats_() {}
+    tls_session_cache(const tls_session_cache&) = delete;
+    tls_session_cache& operator=(const tls_session_cache&) = delete;
+    ~tls_session_cache() { clear(); }
+
+    void attach(asio::ssl::context& ctx, std::size_t capacity);
+
+    static void prepare(SSL* ssl, const std::string& key);
+    static void record_handshake(SSL* ssl);
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sessions_.size();
+    }
+    void clear();
+    const tls_handshake_stats& stats() const { return stats_; }
+
+  private:
+    static int context_index();
+    static int key_index();
+    static tls_session_cache* from(SSL* ssl);
+    static int new_session(SSL* ssl, SSL_SESSION* session);
+
+    void store(const std::string& key, SSL_SESSION* session);
+    SSL_SESSION* find(const std::string& key);
+
+    using entry = std::pair<std::string, SSL_SESSION*>;
+
+    mutable std::mutex mutex_;
+    std::list<entry> lru_; // Most recently used first
+    std::unordered_map<std::string, std::list<entry>::iterator> sessions_;
+    std::size_t capacity_; // 0 only counts handshakes
+    tls_handshake_stats stats_;
+}; // class tls_session_cache
+
+/**
+ * @brief Hook the cache into ctx, capacity 0 keeps no sessions and only
+ * counts handshakes
+ */
+inline void tls_session_cache::attach(asio::ssl::context& ctx,
+                                      std::size_t capacity) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        capacity_ = capacity;
+    }
+    SSL_CTX* native = ctx.native_handle();
+    SSL_CTX_set_ex_data(native, context_index(), this);
+    SSL_CTX_set_session_cache_mode(
+        native, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(native, &tls_session_cache::new_session);
+}
+
+/**
+ * @brief Tag a connection with its host and port and offer the cached
+ * session, must run before the handshake
+ */
+inline void tls_session_cache::prepare(SSL* ssl, const std::string& key) {
+    tls_session_cache* cache = from(ssl);
+    if (!cache) {
+        return;
+    }
+    SSL_set_ex_data(ssl, key_index(), new std::string(key));
+    if (SSL_SESSION* session = cache->find(key)) {
+        SSL_set_session(ssl, session);
+        SSL_SESSION_free(session);
+    }
+}
+
+/**
+ * @brief Count a completed handshake as full or resumed
+ */
+inline void tls_session_cache::record_handshake(SSL* ssl) {
+    if (tls_session_cache* cache = from(ssl)) {
+        cache->stats_.record(SSL_session_reused(ssl) == 1);
+    }
+}
+
+inline void tls_session_cache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : lru_) {
+        SSL_SESSION_free(entry.second);
+    }
+    lru_.clear();
+    sessions_.clear();
+}
+
+inline int tls_session_cache::context_index() {
+    static int index =
+        SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+inline int tls_session_cache::key_index() {
+    static int index = SSL_get_ex_new_index(
+        0, nullptr, nullptr, nullptr,
+        [](void*, void* key, CRYPTO_EX_DATA*, int, long, void*) {
+            delete static_cast<std::string*>(key);
+        });
+    return index;
+}
+
+inline tls_session_cache* tls_session_cache::from(SSL* ssl) {
+    return static_cast<tls_session_cache*>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), context_index()));
+}
+
+/**
+ * @brief OpenSSL callback for every session the server hands out, a copy
+ * is cached for the same reason find hands out copies
+ */
+inline int tls_session_cache::new_session(SSL* ssl, SSL_SESSION* session) {
+    tls_session_cache* cache = from(ssl);
+    auto* key = static_cast<std::string*>(SSL_get_ex_data(ssl, key_index()));
+    if (!cache || !key || !SSL_SESSION_is_resumable(session)) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(cache->mutex_);
+    if (cache->capacity_ == 0) {
+        return 0;
+    }
+    if (SSL_SESSION* copy = SSL_SESSION_dup(session)) {
+        cache->store(*key, copy);
+    }
+    return 0;
+}
+
+// Called with mutex_ held
+inline void tls_session_cache::store(const std::string& key,
+                                     SSL_SESSION* session) {
+    auto it = sessions_.find(key);
+    if (it != sessions_.end()) {
+        SSL_SESSION_free(it->second->second);
+        it->second->second = session;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+    if (sessions_.size() >= capacity_) {
+        SSL_SESSION_free(lru_.back().second);
+        sessions_.erase(lru_.back().first);
+        lru_.pop_back();
+    }
+    lru_.emplace_front(key, session);
+    sessions_.emplace(key, lru_.begin());
+}
+
+/**
+ * @brief Copy of the live session of key
+ * Connections never hold the cached session itself, OpenSSL marks the
+ * session of a connection closed without a TLS shutdown as not resumable.
+ */
+inline SSL_SESSION* tls_session_cache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sessions_.find(key);
+    if (it == sessions_.end()) {
+        return nullptr;
+    }
+    SSL_SESSION* session = it->second->second;
+    bool expired = SSL_SESSION_get_time(session) +
+                       SSL_SESSION_get_timeout(session) <=
+                   static_cast<long>(std::time(nullptr));
+    if (expired) {
+        SSL_SESSION_free(session);
+        lru_.erase(it->second);
+        sessions_.erase(it);
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return SSL_SESSION_dup(session);
+}
+
+/**
+ * @brief Server side session ticket keys rotated on a fixed lifetime
+ * Tickets are encrypted with AES-256-CBC and authenticated with
+ * HMAC-SHA256 under the current key. Tickets of the current and the
+ * previous key are accepted, older ones fall back to a full handshake.
+ * Every resumption is handed a new ticket so clients move to the current
+ * key. Needs OpenSSL 3, on older versions attach fails and OpenSSL's own
+ * key is used.
+ */
+class tls_ticket_keys {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    tls_ticket_keys()
+        : mutex_(), current_(), previous_(), has_previous_(false),
+          lifetime_(0), rotations_(0) {}
+    tls_ticket_keys(const tls_ticket_keys&) = delete;
+    tls_ticket_keys& operator=(const tls_ticket_keys&) = delete;
+
+    bool attach(asio::ssl::context& ctx, std::chrono::seconds lifetime);
+
+    uint64_t rotations() const {
+        return rotations_.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct ticket_key {
+        std::array<unsigned char, 16> name;
+        std::array<unsigned char, 32> aes;
+        std::array<unsigned char, 32> hmac;
+        clock::time_point created;
+    };
+
+    static int context_index();
+    static bool generate(ticket_key& key);
+    void rotate_if_due(clock::time_point now);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int ticket_callback(SSL* ssl, unsigned char* name,
+                               unsigned char* iv, EVP_CIPHER_CTX* cipher,
+                               EVP_MAC_CTX* mac, int encrypt);
+#endif
+
+    std::mutex mutex_;
+    ticket_key current_;
+    ticket_key previous_;
+    bool has_previous_;
+    std::chrono::seconds lifetime_;
+    std::atomic<uint64_t> rotations_;
+}; // class tls_ticket_keys
+
+inline bool tls_ticket_keys::attach(asio::ssl::context& ctx,
+                                    std::chrono::seconds lifetime) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!generate(current_)) {
+            return false;
+        }
+        current_.created = clock::now();
+        has_previous_ = false;
+        lifetime_ = lifetime;
+    }
+    SSL_CTX* native = ctx.native_handle();
+    SSL_CTX_set_ex_data(native, context_index(), this);
+    // A ticket is accepted for up to two key lifetimes
+    SSL_CTX_set_timeout(native, static_cast<long>(2 * lifetime.count()));
+    return SSL_CTX_set_tlsext_ticket_key_evp_cb(
+               native, &tls_ticket_keys::ticket_callback) == 1;
+#else
+    return false;
+#endif
+}
+
+inline int tls_ticket_keys::context_index() {
+    static int index =
+        SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+inline bool tls_ticket_keys::generate(ticket_key& key) {
+    return RAND_bytes(key.name.data(), key.name.size()) == 1 &&
+           RAND_bytes(key.aes.data(), key.aes.size()) == 1 &&
+           RAND_bytes(key.hmac.data(), key.hmac.size()) == 1;
+}
+
+// Called with mutex_ held
+inline void tls_ticket_keys::rotate_if_due(clock::time_point now) {
+    if (now - current_.created < lifetime_) {
+        return;
+    }
+    ticket_key next;
+    if (!generate(next)) {
+        return;
+    }
+    next.created = now;
+    previous_ = current_;
+    has_previous_ = now - previous_.created < 2 * lifetime_;
+    current_ = next;
+    rotations_.fetch_add(1, std::memory_order_relaxed);
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+/**
+ * @brief OpenSSL ticket key callback
+ * Returns 2 to accept and renew a ticket and 0 for an unknown or expired
+ * key.
+ */
+inline int tls_ticket_keys::ticket_callback(SSL* ssl, unsigned char* name,
+                                            unsigned char* iv,
+                                            EVP_CIPHER_CTX* cipher,
+                                            EVP_MAC_CTX* mac, int encrypt) {
+    auto* keys = static_cast<tls_ticket_keys*>(
+        SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), context_index()));
+    if (!keys) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(keys->mutex_);
+    auto now = clock::now();
+    keys->rotate_if_due(now);
+
+    const ticket_key* key = &keys->current_;
+    if (encrypt) {
+        if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) !=
+            1) {
+            return -1;
+        }
+        std::memcpy(name, key->name.data(), key->name.size());
+    } else if (std::memcmp(name, keys->current_.name.data(),
+                           key->name.size()) != 0) {
+        if (!keys->has_previous_ ||
+            now - keys->previous_.created >= 2 * keys->lifetime_ ||
+            std::memcmp(name, keys->previous_.name.data(),
+                        key->name.size()) != 0) {
+            return 0;
+        }
+        key = &keys->previous_;
+    }
+
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(
+            OSSL_MAC_PARAM_KEY, const_cast<unsigned char*>(key->hmac.data()),
+            key->hmac.size()),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()};
+    if (EVP_MAC_CTX_set_params(mac, params) != 1) {
+        return -1;
+    }
+    int initialized =
+        encrypt ? EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr,
+                                     key->aes.data(), iv)
+                : EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr,
+                                     key->aes.data(), iv);
+    if (initialized != 1) {
+        return -1;
+    }
+    return encrypt ? 1 : 2;
+}
+#endif
+
+} // namespace wired
+
+#endif // WIRED_TLS_SESSION_H
@@ -0,0 +1,169 @@
+#ifndef WIRED_TRANSPORT_H
+#define WIRED_TRANSPORT_H
+
+#include <asio.hpp>
+#include <asio/ssl.hpp>
+
+#include "wired/shm_stream.h"
+#include "wired/types.h"
+
+#include <utility>
+#include <variant>
+
+namespace wired {
+
+/**
+ * @brief Byte stream of a connection: TLS over TCP, plain TCP, a plain
+ * unix domain socket or shm rings set up over a unix domain socket
+ * Satisfies asio's AsyncReadStream and AsyncWriteStream so the composed
+ * operations work on it directly, every operation is forwarded to the
+ * stream chosen at construction. The plain streams have no handshake and
+ * never call into OpenSSL.
+ */
+class transport_stream {
+  public:
+    using socket_t = asio::ip::tcp::socket;
+    using tls_stream_t = asio::ssl::stream<socket_t>;
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    using local_socket_t = asio::local::stream_protocol::socket;
+#endif
+    using executor_type = socket_t::executor_type;
+
+  public:
+    transport_stream(socket_t&& socket, asio::ssl::context& ssl_context)
+        : stream_(std::in_place_type<tls_stream_t>, std::move(socket),
+                  ssl_context) {}
+    explicit transport_stream(socket_t&& socket)
+        : stream_(std::in_place_type<socket_t>, std::move(socket)) {}
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    explicit transport_stream(local_socket_t&& socket)
+        : stream_(std::in_place_type<local_socket_t>, std::move(socket)) {}
+#endif
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+    explicit transport_stream(shm_stream&& stream)
+        : stream_(std::in_place_type<shm_stream>, std::move(stream)) {}
+#endif
+
+    bool secure() const {
+        return std::holds_alternative<tls_stream_t>(stream_);
+    }
+    // Whether the stream runs over tcp, with or without TLS
+    bool is_tcp() const {
+        return secure() || std::holds_alternative<socket_t>(stream_);
+    }
+    // Only valid on a secure stream
+    tls_stream_t& tls() { return std::get<tls_stream_t>(stream_); }
+    const tls_stream_t& tls() const { return std::get<tls_stream_t>(stream_); }
+
+    // Only valid on a tcp stream, with or without TLS
+    socket_t& tcp_socket() {
+        if (auto* tls_stream = std::get_if<tls_stream_t>(&stream_)) {
+            return tls_stream->next_layer();
+        }
+        return std::get<socket_t>(stream_);
+    }
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    // Only valid on a unix domain socket or shm stream
+    local_socket_t& local_socket() {
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+        if (auto* shm = std::get_if<shm_stream>(&stream_)) {
+            return shm->socket();
+        }
+#endif
+        return std::get<local_socket_t>(stream_);
+    }
+#endif
+
+    executor_type get_executor() {
+        return std::visit(
+            [](auto& stream) -> executor_type {
+                return stream.lowest_layer().get_executor();
+            },
+            stream_);
+    }
+    bool is_open() const {
+        return std::visit(
+            [](const auto& stream) { return stream.lowest_layer().is_open(); },
+            stream_);
+    }
+    void shutdown(asio::error_code& error) {
+        std::visit(
+            [&error](auto& stream) {
+                stream.lowest_layer().shutdown(
+                    asio::socket_base::shutdown_both, error);
+            },
+            stream_);
+    }
+    void close(asio::error_code& error) {
+        std::visit(
+            [&error](auto& stream) { stream.lowest_layer().close(error); },
+            stream_);
+    }
+
+    template <typename Handler>
+    void async_handshake(handshake_role role, Handler&& handler);
+    template <typename MutableBuffers, typename Handler>
+    void async_read_some(const MutableBuffers& buffers, Handler&& handler);
+    template <typename ConstBuffers, typename Handler>
+    void async_write_some(const ConstBuffers& buffers, Handler&& handler);
+
+  private:
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+    std::variant<tls_stream_t, socket_t, local_socket_t, shm_stream> stream_;
+#elif defined(ASIO_HAS_LOCAL_SOCKETS)
+    std::variant<tls_stream_t, socket_t, local_socket_t> stream_;
+#else
+    std::variant<tls_stream_t, socket_t> stream_;
+#endif
+}; // class transport_stream
+
+/**
+ * @brief Run the TLS or shm handshake, a plain stream completes right away
+ * with success on the handler's executor
+ */
+template <typename Handler>
+void transport_stream::async_handshake(handshake_role role,
+                                       Handler&& handler) {
+    if (auto* tls_stream = std::get_if<tls_stream_t>(&stream_)) {
+        tls_stream->async_handshake(role == handshake_role::server
+                                        ? asio::ssl::stream_base::server
+                                        : asio::ssl::stream_base::client,
+                                    std::forward<Handler>(handler));
+        return;
+    }
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+    if (auto* shm = std::get_if<shm_stream>(&stream_)) {
+        shm->async_handshake(role, std::forward<Handler>(handler));
+        return;
+    }
+#endif
+    auto executor = asio::get_associated_executor(handler, get_executor());
+    asio::post(executor,
+               [handler = std::forward<Handler>(handler)]() mutable {
+                   handler(asio::error_code());
+               });
+}
+
+template <typename MutableBuffers, typename Handler>
+void transport_stream::async_read_some(const MutableBuffers& buffers,
+                                       Handler&& handler) {
+    std::visit(
+        [&buffers, &handler](auto& stream) {
+            stream.async_read_some(buffers, std::forward<Handler>(handler));
+        },
+        stream_);
+}
+
+template <typename ConstBuffers, typename Handler>
+void transport_stream::async_write_some(const ConstBuffers& buffers,
+                                        Handler&& handler) {
+    std::visit(
+        [&buffers, &handler](auto& stream) {
+            stream.async_write_some(buffers, std::forward<Handler>(handler));
+        },
+        stream_);
+}
+
+} // namespace wired
+
+#endif // WIRED_TRANSPORT_H
@@ -75,9 +75,6 @@ class ts_deque {
     void pop_back();
     void pop_front();
 
-    template <typename... Args>
-    void add_message(message_strategy strategy, Args&&... args);
-
     void erase_remove(value_type value);
 
   private:
@@ -281,19 +278,6 @@ void ts_deque<T>::pop_front() {
     deque_.pop_front();
 }
 
-template <typename T>
-template <typename... Args>
-void ts_deque<T>::add_message(message_strategy strategy, Args&&... args) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (strategy == message_strategy::normal) {
-        deque_.emplace_back(std::forward<Args>(args)...);
-    } else if (strategy == message_strategy::immediate) {
-        deque_.emplace_front(std::forward<Args>(args)...);
-    } else {
-        throw std::invalid_argument("Invalid/Unsupported message strategy");
-    }
-}
-
 template <typename T>
 void ts_deque<T>::erase_remove(value_type value) {
     std::lock_guard<std::mutex> lock(mutex_);
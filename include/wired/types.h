@@ -1,8 +1,14 @@
 #ifndef WIRED_TYPES_H
 #define WIRED_TYPES_H
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <asio.hpp>
 #include <asio/ssl.hpp>
 
 namespace wired {
@@ -17,7 +23,8 @@ class tls_options {
   public:
     tls_options()
         : certificate_file_(""), private_key_file_(""),
-          verify_mode_(tls_verify_mode::none) {}
+          verify_mode_(tls_verify_mode::none), session_tickets_(true),
+          session_cache_size_(256), ticket_key_lifetime_(3600) {}
 
     tls_options& set_certificate_file(const std::string& file) {
         certificate_file_ = file;
@@ -34,10 +41,34 @@ class tls_options {
         return *this;
     }
 
+    tls_options& set_session_tickets(bool enabled) {
+        session_tickets_ = enabled;
+        return *this;
+    }
+
+    // Sessions a client keeps for resuming, one per host and port, 0 turns
+    // resumption off
+    tls_options& set_session_cache_size(std::size_t sessions) {
+        session_cache_size_ = sessions;
+        return *this;
+    }
+
+    // How long a server issues tickets under one key, tickets of the
+    // previous key stay valid as long again. 0 keeps OpenSSL's single key.
+    tls_options& set_ticket_key_lifetime(std::chrono::seconds lifetime) {
+        ticket_key_lifetime_ = lifetime;
+        return *this;
+    }
+
     // Getters for configuration options
     const std::string& certificate_file() const { return certificate_file_; }
     const std::string& private_key_file() const { return private_key_file_; }
     tls_verify_mode verify_mode() const { return verify_mode_; }
+    bool session_tickets() const { return session_tickets_; }
+    std::size_t session_cache_size() const { return session_cache_size_; }
+    std::chrono::seconds ticket_key_lifetime() const {
+        return ticket_key_lifetime_;
+    }
 
     asio::ssl::verify_mode to_asio_verify_mode() const {
         switch (verify_mode_) {
@@ -62,19 +93,556 @@ class tls_options {
                                      asio::ssl::context::pem);
         }
         ctx.set_verify_mode(options.to_asio_verify_mode());
+        // Servers verifying clients refuse to resume without a context
+        static constexpr unsigned char session_id_context[] = "wired";
+        SSL_CTX_set_session_id_context(ctx.native_handle(), session_id_context,
+                                       sizeof(session_id_context) - 1);
+        if (options.session_tickets()) {
+            SSL_CTX_clear_options(ctx.native_handle(), SSL_OP_NO_TICKET);
+        } else {
+            SSL_CTX_set_options(ctx.native_handle(), SSL_OP_NO_TICKET);
+        }
     }
 
   private:
     std::string certificate_file_; // Path to the certificate file
     std::string private_key_file_; // Path to the private key file
     tls_verify_mode verify_mode_;  // Custom verification mode
+    bool session_tickets_;         // Issue and accept session tickets
+    std::size_t session_cache_size_;          // Client sessions kept
+    std::chrono::seconds ticket_key_lifetime_; // Server ticket key rotation
+};
+
+class compression_options {
+  public:
+    compression_options() : enabled_(false), threshold_(512) {}
+
+    compression_options& set_enabled(bool enabled) {
+        enabled_ = enabled;
+        return *this;
+    }
+
+    compression_options& set_threshold(std::size_t bytes) {
+        threshold_ = bytes > 0 ? bytes : 1;
+        return *this;
+    }
+
+    // Getters for configuration options
+    bool enabled() const { return enabled_; }
+    std::size_t threshold() const { return threshold_; }
+
+  private:
+    bool enabled_;          // Compress outgoing bodies
+    std::size_t threshold_; // Smallest body worth compressing
+};
+
+/**
+ * @brief How a server accepts connections
+ * Accepting continues while handshakes run, up to max_pending_handshakes
+ * of them at once. A handshake still running after handshake_timeout is
+ * abandoned and its connection closed. An accept failing because the
+ * process ran out of descriptors or memory is retried after
+ * accept_retry_delay instead of at once.
+ */
+class accept_options {
+  public:
+    accept_options()
+        : max_pending_handshakes_(64), handshake_timeout_(10000),
+          listen_backlog_(asio::socket_base::max_listen_connections),
+          handshake_threads_(0), accept_retry_delay_(50) {}
+
+    accept_options& set_max_pending_handshakes(std::size_t count) {
+        max_pending_handshakes_ = count > 0 ? count : 1;
+        return *this;
+    }
+
+    // 0 lets a handshake run forever
+    accept_options&
+    set_handshake_timeout(std::chrono::milliseconds timeout) {
+        handshake_timeout_ = timeout;
+        return *this;
+    }
+
+    accept_options& set_listen_backlog(int backlog) {
+        listen_backlog_ = backlog;
+        return *this;
+    }
+
+    // Threads running handshakes apart from the io threads, 0 runs them on
+    // the io threads
+    accept_options& set_handshake_threads(std::size_t count) {
+        handshake_threads_ = count;
+        return *this;
+    }
+
+    accept_options&
+    set_accept_retry_delay(std::chrono::milliseconds delay) {
+        accept_retry_delay_ = delay;
+        return *this;
+    }
+
+    std::size_t max_pending_handshakes() const {
+        return max_pending_handshakes_;
+    }
+    std::chrono::milliseconds handshake_timeout() const {
+        return handshake_timeout_;
+    }
+    int listen_backlog() const { return listen_backlog_; }
+    std::size_t handshake_threads() const { return handshake_threads_; }
+    std::chrono::milliseconds accept_retry_delay() const {
+        return accept_retry_delay_;
+    }
+
+  private:
+    std::size_t max_pending_handshakes_; // Handshakes in flight at once
+    std::chrono::milliseconds handshake_timeout_; // Deadline per handshake
+    int listen_backlog_; // Pending connections queued by the kernel
+    std::size_t handshake_threads_; // Size of the handshake pool
+    std::chrono::milliseconds accept_retry_delay_; // Backoff when exhausted
 };
 
+/**
+ * @brief Layout of the fields in a message body
+ * stack appends every field and reads them back from the end, consuming the
+ * body, so fields come out in reverse order. forward prefixes ranges with
+ * their length and reads front to back through a cursor without touching
+ * the body, so a message can be decoded again or forwarded untouched.
+ */
+enum class message_encoding : uint8_t {
+    stack,
+    forward
+}; // enum class message_encoding
+
+/**
+ * @brief Byte stream a connection runs over
+ * tcp skips the TLS handshake and record encryption and never touches
+ * OpenSSL, only use it on trusted links such as loopback or a private
+ * cluster network. shm only applies to unix domain socket endpoints, the
+ * socket hands over a pair of shared memory rings that carry every message
+ * after it, any other endpoint falls back to tcp.
+ */
+enum class transport : uint8_t {
+    tls,
+    tcp,
+    shm
+}; // enum class transport
+
+/**
+ * @brief Priority level of an outgoing message, lower levels are more
+ * urgent
+ * A connection schedules send_scheduler_options::levels() levels, any value
+ * below that count is a valid level and larger ones fall into the last
+ * level. immediate is the former name of control.
+ */
 enum class message_strategy : uint8_t {
-    normal = 1 << 0,
-    immediate = 1 << 1
+    control = 0,
+    high = 1,
+    normal = 2,
+    bulk = 3,
+    immediate = control
 }; // enum class message_strategy
 
+/**
+ * @brief How a connection picks the next message among its priority levels
+ * The first strict_levels levels are served in strict priority order. The
+ * levels after them share the link by deficit round robin, each getting
+ * bytes in proportion to its weight, quantum bytes per weight unit and
+ * round. A non-empty level passed over starvation_limit times in a row is
+ * served next whatever its priority, 0 turns that protection off.
+ */
+class send_scheduler_options {
+  public:
+    send_scheduler_options()
+        : levels_(4), strict_levels_(1), weights_{8, 4, 2, 1},
+          quantum_(16 * 1024), starvation_limit_(256) {}
+
+    send_scheduler_options& set_levels(std::size_t count) {
+        levels_ = std::clamp<std::size_t>(count, 1, 16);
+        return *this;
+    }
+
+    send_scheduler_options& set_strict_levels(std::size_t count) {
+        strict_levels_ = count;
+        return *this;
+    }
+
+    send_scheduler_options& set_weight(std::size_t level, uint32_t weight) {
+        if (level >= weights_.size()) {
+            weights_.resize(level + 1, 1);
+        }
+        weights_[level] = std::max<uint32_t>(weight, 1);
+        return *this;
+    }
+
+    send_scheduler_options& set_quantum(std::size_t bytes) {
+        quantum_ = std::max<std::size_t>(bytes, 1);
+        return *this;
+    }
+
+    send_scheduler_options& set_starvation_limit(std::size_t passes) {
+        starvation_limit_ = passes;
+        return *this;
+    }
+
+    // Getters for configuration options
+    std::size_t levels() const { return levels_; }
+    std::size_t strict_levels() const {
+        return std::min(strict_levels_, levels_);
+    }
+    uint32_t weight(std::size_t level) const {
+        return level < weights_.size() ? weights_[level] : 1;
+    }
+    std::size_t quantum() const { return quantum_; }
+    std::size_t starvation_limit() const { return starvation_limit_; }
+
+  private:
+    std::size_t levels_;           // Priority levels per connection
+    std::size_t strict_levels_;    // Leading levels served strictly first
+    std::vector<uint32_t> weights_; // Share of each weighted level
+    std::size_t quantum_;          // Bytes per weight unit and round
+    std::size_t starvation_limit_; // Passes before a level is promoted
+};
+
+/**
+ * @brief What a connection does with a send that would take its outgoing
+ * queue above the high watermark
+ * reject fails the new message, drop_oldest and drop_newest discard the
+ * oldest or the newest message of the least urgent non-empty priority
+ * level until the new one fits, disconnect closes the connection to the
+ * slow consumer. Messages already being written are never discarded.
+ */
+enum class overflow_policy : uint8_t {
+    reject,
+    drop_oldest,
+    drop_newest,
+    disconnect
+}; // enum class overflow_policy
+
+/**
+ * @brief Limits of a connection's outgoing queue
+ * The queue is bounded in bytes and in messages, 0 leaves a dimension
+ * unbounded. A connection stops being writable once either count reaches
+ * its high watermark and becomes writable again when both are at or below
+ * their low watermarks. A low watermark of 0 is half the high one.
+ */
+class send_queue_options {
+  public:
+    send_queue_options()
+        : high_watermark_bytes_(0), low_watermark_bytes_(0),
+          high_watermark_messages_(0), low_watermark_messages_(0),
+          overflow_policy_(overflow_policy::reject) {}
+
+    send_queue_options& set_high_watermark_bytes(std::size_t bytes) {
+        high_watermark_bytes_ = bytes;
+        return *this;
+    }
+
+    send_queue_options& set_low_watermark_bytes(std::size_t bytes) {
+        low_watermark_bytes_ = bytes;
+        return *this;
+    }
+
+    send_queue_options& set_high_watermark_messages(std::size_t count) {
+        high_watermark_messages_ = count;
+        return *this;
+    }
+
+    send_queue_options& set_low_watermark_messages(std::size_t count) {
+        low_watermark_messages_ = count;
+        return *this;
+    }
+
+    send_queue_options& set_overflow_policy(wired::overflow_policy policy) {
+        overflow_policy_ = policy;
+        return *this;
+    }
+
+    // Getters for configuration options
+    bool bounded() const {
+        return high_watermark_bytes_ > 0 || high_watermark_messages_ > 0;
+    }
+    std::size_t high_watermark_bytes() const { return high_watermark_bytes_; }
+    std::size_t low_watermark_bytes() const {
+        return low_watermark(low_watermark_bytes_, high_watermark_bytes_);
+    }
+    std::size_t high_watermark_messages() const {
+        return high_watermark_messages_;
+    }
+    std::size_t low_watermark_messages() const {
+        return low_watermark(low_watermark_messages_, high_watermark_messages_);
+    }
+    wired::overflow_policy overflow_policy() const { return overflow_policy_; }
+
+    // Whether a queue holding bytes in messages is above the high marks
+    bool above_high(std::size_t bytes, std::size_t messages) const {
+        return (high_watermark_bytes_ > 0 && bytes > high_watermark_bytes_) ||
+               (high_watermark_messages_ > 0 &&
+                messages > high_watermark_messages_);
+    }
+    bool at_high(std::size_t bytes, std::size_t messages) const {
+        return (high_watermark_bytes_ > 0 && bytes >= high_watermark_bytes_) ||
+               (high_watermark_messages_ > 0 &&
+                messages >= high_watermark_messages_);
+    }
+    bool at_low(std::size_t bytes, std::size_t messages) const {
+        return (high_watermark_bytes_ == 0 || bytes <= low_watermark_bytes()) &&
+               (high_watermark_messages_ == 0 ||
+                messages <= low_watermark_messages());
+    }
+
+  private:
+    static std::size_t low_watermark(std::size_t low, std::size_t high) {
+        return low > 0 ? std::min(low, high) : high / 2;
+    }
+
+    std::size_t high_watermark_bytes_;    // Queued bytes that stop writes
+    std::size_t low_watermark_bytes_;     // Queued bytes that resume writes
+    std::size_t high_watermark_messages_; // Queued messages that stop writes
+    std::size_t low_watermark_messages_;  // Queued messages resuming writes
+    wired::overflow_policy overflow_policy_; // Handling of sends above high
+};
+
+/**
+ * @brief Holding small sends back so they leave in fewer, larger writes
+ * While enabled an idle connection starts writing once flush_bytes are
+ * queued or flush_delay after the first message it holds, whichever comes
+ * first. control level messages and connection::flush write right away.
+ */
+class coalesce_options {
+  public:
+    coalesce_options()
+        : enabled_(false), flush_bytes_(16 * 1024), flush_delay_(200) {}
+
+    coalesce_options& set_enabled(bool enabled) {
+        enabled_ = enabled;
+        return *this;
+    }
+
+    coalesce_options& set_flush_bytes(std::size_t bytes) {
+        flush_bytes_ = std::max<std::size_t>(bytes, 1);
+        return *this;
+    }
+
+    coalesce_options& set_flush_delay(std::chrono::microseconds delay) {
+        flush_delay_ = delay;
+        return *this;
+    }
+
+    // Getters for configuration options
+    bool enabled() const { return enabled_; }
+    std::size_t flush_bytes() const { return flush_bytes_; }
+    std::chrono::microseconds flush_delay() const { return flush_delay_; }
+
+  private:
+    bool enabled_;                          // Hold sends back at all
+    std::size_t flush_bytes_;               // Queued bytes that start a write
+    std::chrono::microseconds flush_delay_; // Longest a send is held back
+};
+
+/**
+ * @brief Options applied to a connection's socket once it is connected
+ * no_delay and keep_alive only concern tcp and tls connections. A buffer
+ * size of 0 keeps the operating system's default. no_delay is on by
+ * default since a connection already batches its writes itself.
+ */
+class socket_options {
+  public:
+    socket_options()
+        : no_delay_(true), keep_alive_(false), send_buffer_size_(0),
+          receive_buffer_size_(0) {}
+
+    socket_options& set_no_delay(bool no_delay) {
+        no_delay_ = no_delay;
+        return *this;
+    }
+
+    socket_options& set_keep_alive(bool keep_alive) {
+        keep_alive_ = keep_alive;
+        return *this;
+    }
+
+    socket_options& set_send_buffer_size(std::size_t bytes) {
+        send_buffer_size_ = bytes;
+        return *this;
+    }
+
+    socket_options& set_receive_buffer_size(std::size_t bytes) {
+        receive_buffer_size_ = bytes;
+        return *this;
+    }
+
+    // Getters for configuration options
+    bool no_delay() const { return no_delay_; }
+    bool keep_alive() const { return keep_alive_; }
+    std::size_t send_buffer_size() const { return send_buffer_size_; }
+    std::size_t receive_buffer_size() const { return receive_buffer_size_; }
+
+  private:
+    bool no_delay_;                   // TCP_NODELAY
+    bool keep_alive_;                 // SO_KEEPALIVE
+    std::size_t send_buffer_size_;    // SO_SNDBUF
+    std::size_t receive_buffer_size_; // SO_RCVBUF
+};
+
+enum class handshake_role {
+    client,
+    server
+}; // enum class handshake_role
+
+class connection_options {
+  public:
+    connection_options()
+        : max_write_batch_messages_(64), max_write_batch_bytes_(64 * 1024),
+          receive_buffer_size_(64 * 1024), body_pool_buffers_(64),
+          body_pool_bytes_(4 * 1024 * 1024),
+          message_encoding_(message_encoding::stack),
+          max_frame_size_(64 * 1024 * 1024), compression_(),
+          transport_(transport::tls), shm_ring_size_(1024 * 1024),
+          shm_busy_poll_(false), datagrams_(false), send_queue_(),
+          inbox_capacity_(1024), send_scheduler_(), coalescing_(),
+          socket_() {}
+
+    connection_options& set_max_write_batch_messages(std::size_t count) {
+        max_write_batch_messages_ = count > 0 ? count : 1;
+        return *this;
+    }
+
+    connection_options& set_max_write_batch_bytes(std::size_t bytes) {
+        max_write_batch_bytes_ = bytes;
+        return *this;
+    }
+
+    connection_options& set_receive_buffer_size(std::size_t bytes) {
+        receive_buffer_size_ = std::max<std::size_t>(bytes, 256);
+        return *this;
+    }
+
+    // Every connection has its own pool of received bodies, it keeps at
+    // most count buffers per size class and body_pool_bytes of them in
+    // total. That budget is the idle memory a connection may hold on to
+    // after receiving large messages, 4 MiB by default.
+    connection_options& set_body_pool_buffers(std::size_t count) {
+        body_pool_buffers_ = count;
+        return *this;
+    }
+
+    connection_options& set_body_pool_bytes(std::size_t bytes) {
+        body_pool_bytes_ = bytes;
+        return *this;
+    }
+
+    connection_options& set_message_encoding(message_encoding encoding) {
+        message_encoding_ = encoding;
+        return *this;
+    }
+
+    connection_options& set_max_frame_size(std::size_t bytes) {
+        max_frame_size_ = bytes;
+        return *this;
+    }
+
+    connection_options& set_compression(const compression_options& options) {
+        compression_ = options;
+        return *this;
+    }
+
+    connection_options& set_transport(wired::transport kind) {
+        transport_ = kind;
+        return *this;
+    }
+
+    connection_options& set_shm_ring_size(std::size_t bytes) {
+        shm_ring_size_ = std::bit_ceil(std::max<std::size_t>(bytes, 4096));
+        return *this;
+    }
+
+    connection_options& set_shm_busy_poll(bool busy_poll) {
+        shm_busy_poll_ = busy_poll;
+        return *this;
+    }
+
+    // Open an unreliable UDP channel next to tls connections, the server
+    // listens for datagrams on the port number of its tcp listener
+    connection_options& set_datagrams(bool enabled) {
+        datagrams_ = enabled;
+        return *this;
+    }
+
+    connection_options& set_send_queue(const send_queue_options& options) {
+        send_queue_ = options;
+        return *this;
+    }
+
+    // Received messages waiting for the consumer before the connection
+    // stops reading from its socket, 0 never stops
+    connection_options& set_inbox_capacity(std::size_t messages) {
+        inbox_capacity_ = messages;
+        return *this;
+    }
+
+    connection_options&
+    set_send_scheduler(const send_scheduler_options& options) {
+        send_scheduler_ = options;
+        return *this;
+    }
+
+    connection_options& set_coalescing(const coalesce_options& options) {
+        coalescing_ = options;
+        return *this;
+    }
+
+    connection_options& set_socket(const socket_options& options) {
+        socket_ = options;
+        return *this;
+    }
+
+    // Getters for configuration options
+    std::size_t max_write_batch_messages() const {
+        return max_write_batch_messages_;
+    }
+    std::size_t max_write_batch_bytes() const { return max_write_batch_bytes_; }
+    std::size_t receive_buffer_size() const { return receive_buffer_size_; }
+    std::size_t body_pool_buffers() const { return body_pool_buffers_; }
+    std::size_t body_pool_bytes() const { return body_pool_bytes_; }
+    wired::message_encoding message_encoding() const {
+        return message_encoding_;
+    }
+    std::size_t max_frame_size() const { return max_frame_size_; }
+    const compression_options& compression() const { return compression_; }
+    wired::transport transport() const { return transport_; }
+    std::size_t shm_ring_size() const { return shm_ring_size_; }
+    bool shm_busy_poll() const { return shm_busy_poll_; }
+    bool datagrams() const { return datagrams_; }
+    const send_queue_options& send_queue() const { return send_queue_; }
+    std::size_t inbox_capacity() const { return inbox_capacity_; }
+    const send_scheduler_options& send_scheduler() const {
+        return send_scheduler_;
+    }
+    const coalesce_options& coalescing() const { return coalescing_; }
+    const socket_options& socket() const { return socket_; }
+
+  private:
+    std::size_t max_write_batch_messages_; // Queued messages per single write
+    std::size_t max_write_batch_bytes_; // Soft byte cap for a single write
+    std::size_t receive_buffer_size_;   // Bytes requested per socket read
+    std::size_t body_pool_buffers_;     // Recycled bodies per size class, 0
+                                        // disables the pool
+    std::size_t body_pool_bytes_; // Capacity the body pool may keep
+    wired::message_encoding message_encoding_; // Encoding of received bodies
+    std::size_t max_frame_size_; // Largest body accepted from the peer
+    compression_options compression_; // Compression of outgoing bodies
+    wired::transport transport_;       // Stream used by new connections
+    std::size_t shm_ring_size_; // Bytes per shm ring, a power of two
+    bool shm_busy_poll_;        // Spin on empty shm rings instead of sleeping
+    bool datagrams_;            // UDP channel for send_unreliable
+    send_queue_options send_queue_; // Bounds of the outgoing queue
+    std::size_t inbox_capacity_;    // Unconsumed messages that pause reads
+    send_scheduler_options send_scheduler_; // Priority levels of sends
+    coalesce_options coalescing_;           // Holding back of small sends
+    socket_options socket_;                 // Options of the socket itself
+};
+
+
 enum class execution_policy {
     blocking,
     non_blocking
@@ -83,6 +651,7 @@ enum class execution_policy {
 struct selection_tag_0 {};
 struct selection_tag_1 : selection_tag_0 {};
 struct selection_tag_2 : selection_tag_1 {};
+struct selection_tag_3 : selection_tag_2 {};
 
 } // namespace wired
 
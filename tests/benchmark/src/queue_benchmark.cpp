@@ -0,0 +1,96 @@
+#include "wired.h"
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compares the receive queues: the mutex based ts_deque drained the way the
+// old messaging loop did it (empty, front copy, pop_front) against
+// mpsc_queue drained with try_pop_n
+
+using message_t = wired::message<uint32_t>;
+
+constexpr std::size_t body_size = 32;
+
+message_t make_message(uint32_t id) {
+    message_t msg(id);
+    msg.body().data().resize(body_size);
+    return msg;
+}
+
+template <typename Producer, typename Consumer>
+double run(std::size_t producers, std::size_t total, Producer produce,
+           Consumer consume) {
+    std::size_t per_producer = total / producers;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&produce, per_producer, p]() {
+            for (std::size_t i = 0; i < per_producer; ++i) {
+                produce(make_message(static_cast<uint32_t>(p)));
+            }
+        });
+    }
+    consume(per_producer * producers);
+    auto end = std::chrono::steady_clock::now();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> elapsed = end - start;
+    return static_cast<double>(per_producer * producers) / elapsed.count();
+}
+
+double bench_ts_deque(std::size_t producers, std::size_t total) {
+    wired::ts_deque<message_t> queue;
+    return run(
+        producers, total,
+        [&queue](message_t&& msg) { queue.emplace_back(std::move(msg)); },
+        [&queue](std::size_t expected) {
+            std::size_t received = 0;
+            while (received < expected) {
+                while (!queue.empty()) {
+                    message_t msg = queue.front();
+                    queue.pop_front();
+                    ++received;
+                }
+            }
+        });
+}
+
+double bench_mpsc_queue(std::size_t producers, std::size_t total) {
+    wired::mpsc_queue<message_t> queue;
+    return run(
+        producers, total,
+        [&queue](message_t&& msg) { queue.push(std::move(msg)); },
+        [&queue](std::size_t expected) {
+            std::vector<message_t> batch;
+            batch.reserve(64);
+            std::size_t received = 0;
+            while (received < expected) {
+                received += queue.try_pop_n(std::back_inserter(batch), 64);
+                batch.clear();
+            }
+        });
+}
+
+int main(int argc, char** argv) {
+    std::size_t total = 2'000'000;
+    if (argc > 1) {
+        total = std::stoull(argv[1]);
+    }
+
+    std::cout << "messages: " << total << ", body size: " << body_size
+              << " bytes\n";
+    std::cout << "producers | ts_deque msg/s | mpsc_queue msg/s | speedup\n";
+    for (std::size_t producers : {1, 4, 16}) {
+        double deque_rate = bench_ts_deque(producers, total);
+        double mpsc_rate = bench_mpsc_queue(producers, total);
+        std::cout << std::format("{:>9} | {:>14.0f} | {:>16.0f} | {:>6.2f}x\n",
+                                 producers, deque_rate, mpsc_rate,
+                                 mpsc_rate / deque_rate);
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "wired.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compares the transports on one host: a client sends messages that the
+// server echoes back on the same connection. Latency keeps a single message
+// in flight, throughput posts every message before waiting for the echoes.
+
+using message_t = wired::message<uint32_t>;
+
+constexpr std::size_t body_size = 64;
+
+class echo_server : public wired::server_interface<uint32_t> {
+  public:
+    void on_message(message_t& msg, connection_ptr conn) override {
+        post(conn, msg);
+    }
+};
+
+class echo_client : public wired::client_interface<uint32_t> {
+  public:
+    void on_message([[maybe_unused]] message_t& msg,
+                    [[maybe_unused]] connection_ptr conn) override {
+        received_.fetch_add(1, std::memory_order_release);
+    }
+
+    void wait_for(std::size_t count) const {
+        while (received_.load(std::memory_order_acquire) < count) {
+            std::this_thread::yield();
+        }
+    }
+
+  private:
+    std::atomic<std::size_t> received_{0};
+};
+
+struct transport_case {
+    std::string name;
+    wired::connection_options options;
+    bool local;
+};
+
+struct result {
+    double mean_us;
+    double p99_us;
+    double messages_per_second;
+};
+
+result run(const transport_case& test, std::size_t round_trips,
+           std::size_t messages) {
+    echo_server server;
+    echo_client client;
+    server.set_connection_options(test.options);
+    client.set_connection_options(test.options);
+
+    asio::local::stream_protocol::endpoint endpoint("wired_benchmark.sock");
+    if (test.local) {
+        server.start_local(endpoint);
+    } else {
+        server.start("60100");
+    }
+    server.run(wired::execution_policy::non_blocking);
+    bool connected = test.local ? client.connect_local(endpoint).get()
+                                : client.connect("127.0.0.1", "60100").get();
+    if (!connected) {
+        throw std::runtime_error("Could not connect over " + test.name);
+    }
+    client.run(wired::execution_policy::non_blocking);
+
+    message_t msg(1);
+    msg.body().data().resize(body_size);
+    msg.head().sync(body_size);
+
+    std::size_t sent = 0;
+    std::vector<double> latencies;
+    latencies.reserve(round_trips);
+    for (std::size_t i = 0; i < round_trips; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        client.post(msg);
+        client.wait_for(++sent);
+        std::chrono::duration<double, std::micro> elapsed =
+            std::chrono::steady_clock::now() - start;
+        latencies.push_back(elapsed.count());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < messages; ++i) {
+        client.post(msg);
+    }
+    sent += messages;
+    client.wait_for(sent);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+
+    client.disconnect().get();
+    server.shutdown();
+
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (double latency : latencies) {
+        total += latency;
+    }
+    return result{total / static_cast<double>(latencies.size()),
+                  latencies[latencies.size() * 99 / 100],
+                  static_cast<double>(messages) / elapsed.count()};
+}
+
+int main(int argc, char** argv) {
+    std::size_t round_trips = 20'000;
+    std::size_t messages = 200'000;
+    if (argc > 1) {
+        round_trips = std::stoull(argv[1]);
+    }
+    if (argc > 2) {
+        messages = std::stoull(argv[2]);
+    }
+
+    auto tcp = wired::connection_options().set_transport(wired::transport::tcp);
+    auto shm = wired::connection_options().set_transport(wired::transport::shm);
+    auto shm_poll = wired::connection_options(shm).set_shm_busy_poll(true);
+    std::vector<transport_case> cases = {{"tcp loopback", tcp, false},
+                                         {"unix socket", tcp, true},
+                                         {"shm rings", shm, true},
+                                         {"shm busy poll", shm_poll, true}};
+
+    std::cout << "round trips: " << round_trips << ", messages: " << messages
+              << ", body size: " << body_size << " bytes\n";
+    std::cout << "transport     | mean rtt us | p99 rtt us | echoed msg/s\n";
+    for (const auto& test : cases) {
+        result r = run(test, round_trips, messages);
+        std::cout << std::format("{:<13} | {:>11.2f} | {:>10.2f} | {:>12.0f}\n",
+                                 test.name, r.mean_us, r.p99_us,
+                                 r.messages_per_second);
+    }
+    return 0;
+}
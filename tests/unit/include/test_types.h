@@ -1,7 +1,10 @@
 #pragma once
 
+#include "wired/schema.h"
+
 #include <cstdint>
 #include <cstring>
+#include <string>
 #include <vector>
 
 
@@ -52,4 +55,24 @@ class wired_type {
   public:
     uint32_t weight;
     uint64_t factor;
-};
\ No newline at end of file
+};
+
+struct schema_point {
+    int32_t x;
+    int32_t y;
+
+    static constexpr auto wired_fields =
+        wired::schema_fields(&schema_point::x, &schema_point::y);
+};
+
+struct schema_player {
+    uint32_t id;
+    schema_point position;
+    std::string name;
+    std::vector<float> samples;
+    std::vector<std::string> tags;
+
+    static constexpr auto wired_fields = wired::schema_fields(
+        &schema_player::id, &schema_player::position, &schema_player::name,
+        &schema_player::samples, &schema_player::tags);
+};
@@ -0,0 +1,78 @@
+#include "wired.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+TEST(buffer_pool_tests, recycles_within_size_class) {
+    wired::buffer_pool pool(4);
+    auto buffer = pool.acquire(100);
+    EXPECT_EQ(buffer.size(), 100);
+    EXPECT_GE(buffer.capacity(), 128);
+    const uint8_t* storage = buffer.data();
+    EXPECT_EQ(pool.misses(), 1);
+
+    pool.release(std::move(buffer));
+    auto reused = pool.acquire(120);
+    EXPECT_EQ(reused.size(), 120);
+    EXPECT_EQ(reused.data(), storage);
+    EXPECT_EQ(pool.hits(), 1);
+    EXPECT_EQ(pool.misses(), 1);
+}
+
+TEST(buffer_pool_tests, recycled_buffers_are_not_refilled) {
+    wired::buffer_pool pool(4);
+    auto buffer = pool.acquire(100);
+    std::fill(buffer.begin(), buffer.end(), 0xab);
+    pool.release(std::move(buffer));
+
+    // Only the bytes past the released size are zeroed
+    auto reused = pool.acquire(120);
+    EXPECT_EQ(std::count(reused.begin(), reused.begin() + 100, 0xab), 100);
+    EXPECT_EQ(std::count(reused.begin() + 100, reused.end(), 0), 20);
+}
+
+TEST(buffer_pool_tests, oversized_buffers_bypass_pool) {
+    wired::buffer_pool pool(4);
+    auto buffer = pool.acquire(wired::buffer_pool::max_class_size + 1);
+    pool.release(std::move(buffer));
+    pool.acquire(wired::buffer_pool::max_class_size + 1);
+    EXPECT_EQ(pool.hits(), 0);
+    EXPECT_EQ(pool.misses(), 0);
+}
+
+TEST(buffer_pool_tests, retained_bytes_stay_within_budget) {
+    wired::buffer_pool pool(64, 256 * 1024);
+    std::vector<wired::buffer_pool::buffer_t> buffers;
+    for (int i = 0; i < 4; ++i) {
+        buffers.push_back(pool.acquire(100 * 1024));
+    }
+    for (auto& buffer : buffers) {
+        pool.release(std::move(buffer));
+    }
+    // Two buffers of the 128 KiB class fill the budget
+    EXPECT_EQ(pool.retained_bytes(), 256 * 1024);
+
+    pool.acquire(100 * 1024);
+    EXPECT_EQ(pool.hits(), 1);
+    EXPECT_EQ(pool.retained_bytes(), 128 * 1024);
+    pool.release(pool.acquire(64));
+    EXPECT_EQ(pool.retained_bytes(), 128 * 1024 + 64);
+}
+
+TEST(buffer_pool_tests, message_body_returns_buffer) {
+    using message_t = wired::message<uint32_t>;
+    auto pool = std::make_shared<wired::buffer_pool>(4);
+    {
+        message_t msg(1);
+        msg.body() = message_t::message_body_t(pool->acquire(64), pool);
+        message_t moved(std::move(msg));
+        message_t copy(moved);
+    }
+    pool->acquire(64);
+    EXPECT_EQ(pool->hits(), 1);
+    EXPECT_EQ(pool->misses(), 1);
+}
@@ -3,8 +3,19 @@
 #include "test_server.h"
 
 #include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <numeric>
 #include <thread>
 
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 class client_server_tests_fixture : public ::testing::Test {
   public:
     using message_t = wired::message<message_type>;
@@ -100,4 +111,581 @@ TEST_F(client_server_tests_fixture, client_send) {
     }
     std::this_thread::sleep_for(std::chrono::milliseconds(50));
     ASSERT_EQ(server_.get_frequency(message_type::client_message), 3);
-}
\ No newline at end of file
+}
+TEST(client_server_pool_tests, io_thread_pool) {
+    wired::tls_options options;
+    options.set_certificate_file("../server.crt")
+        .set_private_key_file("../server.key")
+        .set_verify_mode(wired::tls_verify_mode::none);
+    server_t server;
+    server.set_tls_options(options);
+    server.set_io_threads(4);
+    server.start("60001");
+    server.run(wired::execution_policy::non_blocking);
+
+    std::array<client_t, 4> clients;
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.connect("localhost", "60001").get());
+        client.run(wired::execution_policy::non_blocking);
+    }
+
+    wired::message<message_type> msg(message_type::client_message);
+    for (int i = 0; i < 50; ++i) {
+        for (auto& client : clients) {
+            client.send(msg);
+        }
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 200;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 200);
+
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    server.shutdown();
+}
+
+// Records the numbers each connection sent in the order on_message saw
+// them, and how many messages were handled at the same time
+class ordering_server_t : public wired::server_interface<message_type> {
+  public:
+    void on_message(message_t& msg, connection_ptr conn) override {
+        std::size_t running = in_flight.fetch_add(1) + 1;
+        std::size_t peak = max_in_flight.load();
+        while (running > peak &&
+               !max_in_flight.compare_exchange_weak(peak, running)) {
+        }
+        int number;
+        msg >> number;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            numbers[conn.get()].push_back(number);
+            ++received;
+        }
+        in_flight.fetch_sub(1);
+    }
+
+    std::size_t received_count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received;
+    }
+
+    std::mutex mutex;
+    std::map<connection_t*, std::vector<int>> numbers;
+    std::size_t received = 0;
+    std::atomic<std::size_t> in_flight{0};
+    std::atomic<std::size_t> max_in_flight{0};
+};
+
+TEST(client_server_pool_tests, destroyed_without_shutdown) {
+    auto server = std::make_unique<server_t>();
+    server->set_connection_options(
+        wired::connection_options().set_transport(wired::transport::tcp));
+    server->set_io_threads(2);
+    server->start("60010");
+    server->run(wired::execution_policy::non_blocking);
+
+    client_t client;
+    client.set_connection_options(
+        wired::connection_options().set_transport(wired::transport::tcp));
+    ASSERT_TRUE(client.connect("localhost", "60010").get());
+    // Returns only once every io thread stopped
+    server.reset();
+}
+
+TEST(client_server_pool_tests, message_workers_keep_connection_order) {
+    constexpr int message_count = 20;
+    auto connection_options =
+        wired::connection_options().set_transport(wired::transport::tcp);
+    ordering_server_t server;
+    server.set_connection_options(connection_options);
+    server.set_message_workers(4);
+    server.start("60009");
+    server.run(wired::execution_policy::non_blocking);
+
+    std::array<client_t, 3> clients;
+    for (auto& client : clients) {
+        client.set_connection_options(connection_options);
+        ASSERT_TRUE(client.connect("localhost", "60009").get());
+        client.run(wired::execution_policy::non_blocking);
+    }
+    for (int i = 0; i < message_count; ++i) {
+        for (auto& client : clients) {
+            wired::message<message_type> msg(message_type::client_message);
+            msg << i;
+            client.post(msg);
+        }
+    }
+    for (int retries = 0;
+         retries < 500 &&
+         server.received_count() < clients.size() * message_count;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server.received_count(), clients.size() * message_count);
+
+    std::vector<int> expected(message_count);
+    std::iota(expected.begin(), expected.end(), 0);
+    {
+        std::lock_guard<std::mutex> lock(server.mutex);
+        ASSERT_EQ(server.numbers.size(), clients.size());
+        for (const auto& [conn, numbers] : server.numbers) {
+            EXPECT_EQ(numbers, expected);
+        }
+    }
+    // Connections hash onto different lanes that run side by side
+    EXPECT_GE(server.max_in_flight.load(), 2);
+
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    server.shutdown();
+}
+
+TEST(client_server_transport_tests, plaintext_tcp) {
+    auto options =
+        wired::connection_options().set_transport(wired::transport::tcp);
+    server_t server;
+    server.set_connection_options(options);
+    server.start("60002");
+    server.run(wired::execution_policy::non_blocking);
+
+    std::array<client_t, 2> clients;
+    for (auto& client : clients) {
+        client.set_connection_options(options);
+        ASSERT_TRUE(client.connect("localhost", "60002").get());
+        client.run(wired::execution_policy::non_blocking);
+    }
+
+    wired::message<message_type> msg(message_type::client_message);
+    for (int i = 0; i < 20; ++i) {
+        for (auto& client : clients) {
+            client.post(msg);
+        }
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 40;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 40);
+
+    // Every connection is registered once its messages arrived
+    for (auto& result :
+         server.send_all(nullptr, wired::message<message_type>(
+                                      message_type::server_message))) {
+        ASSERT_TRUE(result.get());
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         (clients[0].get_frequency(message_type::server_message) < 1 ||
+          clients[1].get_frequency(message_type::server_message) < 1);
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto& client : clients) {
+        EXPECT_EQ(client.get_frequency(message_type::server_message), 1);
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    server.shutdown();
+}
+
+TEST(client_server_transport_tests, compression_from_connection_options) {
+    auto options =
+        wired::connection_options()
+            .set_transport(wired::transport::tcp)
+            .set_compression(wired::compression_options()
+                                 .set_enabled(true)
+                                 .set_threshold(256));
+    server_t server;
+    server.set_connection_options(options);
+    server.start("60003");
+    server.run(wired::execution_policy::non_blocking);
+
+    client_t client;
+    client.set_connection_options(options);
+    ASSERT_TRUE(client.connect("localhost", "60003").get());
+    client.run(wired::execution_policy::non_blocking);
+    for (int retries = 0; retries < 200 && server.connections().size() < 1;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    wired::message<message_type> msg(message_type::server_message);
+    msg << std::vector<uint8_t>(4096, 7);
+    for (auto& result : server.send_all(nullptr, msg)) {
+        ASSERT_TRUE(result.get());
+    }
+    EXPECT_EQ(server.compression_stats().compressed_messages(), 1);
+    for (int retries = 0;
+         retries < 200 &&
+         client.get_frequency(message_type::server_message) < 1;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(client.get_frequency(message_type::server_message), 1);
+    ASSERT_TRUE(client.disconnect().get());
+    server.shutdown();
+}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+TEST(client_server_transport_tests, unix_domain_socket) {
+    asio::local::stream_protocol::endpoint endpoint("wired_unit_test.sock");
+    server_t server;
+    server.start_local(endpoint);
+    server.run(wired::execution_policy::non_blocking);
+
+    std::array<client_t, 2> clients;
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.connect_local(endpoint).get());
+        ASSERT_TRUE(client.is_connected());
+        client.run(wired::execution_policy::non_blocking);
+    }
+
+    wired::message<message_type> msg(message_type::client_message);
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.send(msg).get());
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 2;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 2);
+
+    // Every connection is registered once its messages arrived
+    for (auto& result :
+         server.send_all(nullptr, wired::message<message_type>(
+                                      message_type::server_message))) {
+        ASSERT_TRUE(result.get());
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         (clients[0].get_frequency(message_type::server_message) < 1 ||
+          clients[1].get_frequency(message_type::server_message) < 1);
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    for (auto& client : clients) {
+        EXPECT_EQ(client.get_frequency(message_type::server_message), 1);
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    server.shutdown();
+    EXPECT_FALSE(std::filesystem::exists("wired_unit_test.sock"));
+}
+#endif
+
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+TEST(client_server_transport_tests, shared_memory_rings) {
+    // Rings smaller than a message force partial writes and wakeups
+    auto options = wired::connection_options()
+                       .set_transport(wired::transport::shm)
+                       .set_shm_ring_size(4096);
+    asio::local::stream_protocol::endpoint endpoint("wired_unit_test_shm.sock");
+    server_t server;
+    server.set_connection_options(options);
+    server.start_local(endpoint);
+    server.run(wired::execution_policy::non_blocking);
+
+    client_t client;
+    client.set_connection_options(options);
+    ASSERT_TRUE(client.connect_local(endpoint).get());
+    client.run(wired::execution_policy::non_blocking);
+
+    wired::message<message_type> large(message_type::client_message);
+    large << std::vector<uint8_t>(64 * 1024, 7);
+    for (int i = 0; i < 10; ++i) {
+        client.post(large);
+        client.post(wired::message<message_type>(message_type::client_message));
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 20;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 20);
+
+    for (auto& result :
+         server.send_all(nullptr, wired::message<message_type>(
+                                      message_type::server_message))) {
+        ASSERT_TRUE(result.get());
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         client.get_frequency(message_type::server_message) < 1;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(client.get_frequency(message_type::server_message), 1);
+
+    ASSERT_TRUE(client.disconnect().get());
+    server.shutdown();
+}
+#endif
+
+TEST(client_server_transport_tests, unreliable_datagrams) {
+    wired::tls_options options;
+    options.set_certificate_file("../server.crt")
+        .set_private_key_file("../server.key")
+        .set_verify_mode(wired::tls_verify_mode::none);
+    auto connection_options = wired::connection_options().set_datagrams(true);
+    server_t server;
+    server.set_tls_options(options);
+    server.set_connection_options(connection_options);
+    server.start("60004");
+    server.run(wired::execution_policy::non_blocking);
+
+    std::array<client_t, 2> clients;
+    for (auto& client : clients) {
+        client.set_connection_options(connection_options);
+        ASSERT_TRUE(client.connect("localhost", "60004").get());
+        client.run(wired::execution_policy::non_blocking);
+    }
+    // The client is connected once its side of the handshake is done, the
+    // server registers the datagram channel when its side completes
+    for (int retries = 0;
+         retries < 200 && (server.accept_stats().handshakes_completed() < 2 ||
+                           server.accept_stats().pending_handshakes() > 0);
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    wired::message<message_type> msg(message_type::client_message);
+    msg << uint32_t(42);
+    for (int i = 0; i < 10; ++i) {
+        for (auto& client : clients) {
+            EXPECT_TRUE(client.send_unreliable(msg));
+        }
+    }
+    // Loopback does not lose datagrams
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 20;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 20);
+
+    // Delivered datagrams keep their pooled body and hand it back once
+    // consumed, so later datagrams reuse it
+    auto pool_hits = [&server]() {
+        std::size_t hits = 0;
+        server.connections().for_each([&hits](const auto& conn) {
+            hits += conn->body_pool()->hits();
+        });
+        return hits;
+    };
+    std::size_t hits = pool_hits();
+    for (auto& client : clients) {
+        EXPECT_TRUE(client.send_unreliable(msg));
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 22;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 22);
+    EXPECT_GE(pool_hits(), hits + 2);
+
+    server.send_all_unreliable(
+        nullptr, wired::message<message_type>(message_type::server_message));
+    for (int retries = 0;
+         retries < 200 &&
+         (clients[0].get_frequency(message_type::server_message) < 1 ||
+          clients[1].get_frequency(message_type::server_message) < 1);
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    wired::message<message_type> oversized(message_type::client_message);
+    oversized.body().data().resize(wired::datagram_session::max_packet_size);
+    oversized.head().sync(oversized.body().data().size());
+    for (auto& client : clients) {
+        EXPECT_EQ(client.get_frequency(message_type::server_message), 1);
+        EXPECT_FALSE(client.send_unreliable(oversized));
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    server.shutdown();
+}
+
+TEST(client_server_transport_tests, tls_session_resumption) {
+    wired::tls_options options;
+    options.set_certificate_file("../server.crt")
+        .set_private_key_file("../server.key")
+        .set_verify_mode(wired::tls_verify_mode::none);
+    server_t server;
+    server.set_tls_options(options);
+    server.start("60005");
+    server.run(wired::execution_policy::non_blocking);
+
+    client_t client;
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_TRUE(client.connect("localhost", "60005").get());
+        // TLS 1.3 tickets arrive after the handshake
+        for (int retries = 0;
+             retries < 200 && client.session_cache().size() == 0;
+             ++retries) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ(client.session_cache().size(), 1);
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    EXPECT_EQ(client.handshake_stats().full_handshakes(), 1);
+    EXPECT_EQ(client.handshake_stats().resumed_handshakes(), 2);
+    // The server completes its side after the client's Finished arrived
+    for (int retries = 0;
+         retries < 200 && server.handshake_stats().resumed_handshakes() < 2;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.handshake_stats().full_handshakes(), 1);
+    EXPECT_EQ(server.handshake_stats().resumed_handshakes(), 2);
+    server.shutdown();
+}
+
+TEST(client_server_accept_tests, stalled_handshake_does_not_block_accept) {
+    wired::tls_options options;
+    options.set_certificate_file("../server.crt")
+        .set_private_key_file("../server.key")
+        .set_verify_mode(wired::tls_verify_mode::none);
+    server_t server;
+    server.set_tls_options(options);
+    server.set_accept_options(wired::accept_options().set_handshake_timeout(
+        std::chrono::milliseconds(200)));
+    server.start("60006");
+    server.run(wired::execution_policy::non_blocking);
+
+    // Connects but never starts its handshake
+    asio::io_context io_context;
+    asio::ip::tcp::socket stalled(io_context);
+    stalled.connect(asio::ip::tcp::endpoint(
+        asio::ip::address_v4::loopback(), 60006));
+
+    client_t first;
+    ASSERT_TRUE(first.connect("localhost", "60006").get());
+    for (int retries = 0;
+         retries < 200 && server.accept_stats().handshakes_timed_out() < 1;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.accept_stats().handshakes_timed_out(), 1);
+
+    // Accepting goes on after a handshake failed
+    client_t second;
+    ASSERT_TRUE(second.connect("localhost", "60006").get());
+    // The pending count drops right after the completion is recorded
+    for (int retries = 0;
+         retries < 200 && (server.accept_stats().handshakes_completed() < 2 ||
+                           server.accept_stats().pending_handshakes() > 0);
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.accept_stats().accepted(), 3);
+    EXPECT_EQ(server.accept_stats().handshakes_completed(), 2);
+    EXPECT_EQ(server.accept_stats().handshakes_failed(), 0);
+    EXPECT_EQ(server.accept_stats().pending_handshakes(), 0);
+
+    ASSERT_TRUE(first.disconnect().get());
+    ASSERT_TRUE(second.disconnect().get());
+    server.shutdown();
+}
+
+TEST(client_server_accept_tests, handshake_thread_pool) {
+    wired::tls_options options;
+    options.set_certificate_file("../server.crt")
+        .set_private_key_file("../server.key")
+        .set_verify_mode(wired::tls_verify_mode::none);
+    server_t server;
+    server.set_tls_options(options);
+    server.set_accept_options(
+        wired::accept_options().set_handshake_threads(2));
+    server.start("60007");
+    server.run(wired::execution_policy::non_blocking);
+
+    std::array<client_t, 4> clients;
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.connect("localhost", "60007").get());
+        client.run(wired::execution_policy::non_blocking);
+    }
+
+    wired::message<message_type> msg(message_type::client_message);
+    for (int i = 0; i < 10; ++i) {
+        for (auto& client : clients) {
+            client.send(msg);
+        }
+    }
+    for (int retries = 0;
+         retries < 200 &&
+         server.get_frequency(message_type::client_message) < 40;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.get_frequency(message_type::client_message), 40);
+    EXPECT_EQ(server.accept_stats().handshakes_completed(), 4);
+
+    for (auto& client : clients) {
+        ASSERT_TRUE(client.disconnect().get());
+    }
+    server.shutdown();
+}
+
+#if defined(__linux__)
+// Runs the process out of descriptors while a connection waits to be
+// accepted, every accept then fails until descriptors free up again
+TEST(client_server_accept_tests, exhausted_descriptors_back_off) {
+    server_t server;
+    server.set_connection_options(
+        wired::connection_options().set_transport(wired::transport::tcp));
+    server.set_accept_options(wired::accept_options().set_accept_retry_delay(
+        std::chrono::milliseconds(50)));
+    server.start("60008");
+    server.run(wired::execution_policy::non_blocking);
+
+    int peer = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(peer, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(60008);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    rlimit limit;
+    ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &limit), 0);
+    rlimit lowered = limit;
+    lowered.rlim_cur = static_cast<rlim_t>(peer) + 1;
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &lowered), 0);
+    std::vector<int> filler;
+    for (int fd = ::dup(peer); fd >= 0; fd = ::dup(peer)) {
+        filler.push_back(fd);
+    }
+    ASSERT_EQ(::connect(peer, reinterpret_cast<sockaddr*>(&address),
+                        sizeof(address)),
+              0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    uint64_t errors = server.accept_stats().accept_errors();
+    for (int fd : filler) {
+        ::close(fd);
+    }
+    ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &limit), 0);
+
+    // Retried every 50 ms instead of in a tight loop
+    EXPECT_GE(errors, 1);
+    EXPECT_LE(errors, 10);
+    EXPECT_EQ(server.accept_stats().accepted(), 0);
+    for (int retries = 0;
+         retries < 200 && server.accept_stats().accepted() < 1; ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(server.accept_stats().accepted(), 1);
+    ::close(peer);
+    server.shutdown();
+}
+#endif
@@ -0,0 +1,98 @@
+#include "wired.h"
+
+#include "test_enums.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+std::vector<uint8_t> round_trip(const std::vector<uint8_t>& input,
+                                std::size_t& compressed_size) {
+    std::vector<uint8_t> compressed(
+        wired::lz4_codec::max_compressed_size(input.size()));
+    compressed_size = wired::lz4_codec::compress(input.data(), input.size(),
+                                                 compressed.data());
+    std::vector<uint8_t> output(input.size());
+    EXPECT_TRUE(wired::lz4_codec::decompress(
+        compressed.data(), compressed_size, output.data(), output.size()));
+    return output;
+}
+
+TEST(compression_tests, compressible_round_trip) {
+    std::string text;
+    for (int i = 0; i < 200; ++i) {
+        text += "{\"user\":\"wired\",\"text\":\"hello " + std::to_string(i) +
+                "\"}";
+    }
+    std::vector<uint8_t> input(text.begin(), text.end());
+    std::size_t compressed_size = 0;
+    EXPECT_EQ(round_trip(input, compressed_size), input);
+    EXPECT_LT(compressed_size, input.size() / 3);
+}
+
+TEST(compression_tests, incompressible_and_small_round_trip) {
+    std::mt19937 rng(42);
+    for (std::size_t size : {0, 1, 12, 13, 100, 70000}) {
+        std::vector<uint8_t> input(size);
+        for (auto& byte : input) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        std::size_t compressed_size = 0;
+        EXPECT_EQ(round_trip(input, compressed_size), input);
+        EXPECT_LE(compressed_size,
+                  wired::lz4_codec::max_compressed_size(size));
+    }
+}
+
+TEST(compression_tests, rejects_corrupt_blocks) {
+    std::vector<uint8_t> input(1000, 'a');
+    std::vector<uint8_t> compressed(
+        wired::lz4_codec::max_compressed_size(input.size()));
+    std::size_t compressed_size = wired::lz4_codec::compress(
+        input.data(), input.size(), compressed.data());
+    std::vector<uint8_t> output(input.size());
+
+    EXPECT_FALSE(wired::lz4_codec::decompress(
+        compressed.data(), compressed_size, output.data(), output.size() - 1));
+    EXPECT_FALSE(wired::lz4_codec::decompress(
+        compressed.data(), compressed_size - 1, output.data(), output.size()));
+
+    // A match reaching back before the start of the output
+    uint8_t bad_offset[] = {0x10, 'a', 0x05, 0x00};
+    EXPECT_FALSE(wired::lz4_codec::decompress(bad_offset, sizeof(bad_offset),
+                                              output.data(), 5));
+}
+
+TEST(compression_tests, incompressible_attempts_are_counted) {
+    using message_t = wired::message<message_type>;
+    using connection_t = wired::connection<message_type>;
+
+    std::mt19937 rng(7);
+    std::vector<uint8_t> noise(4096);
+    for (auto& byte : noise) {
+        byte = static_cast<uint8_t>(rng());
+    }
+    message_t random(message_type::vector);
+    random << noise;
+    message_t repeated(message_type::vector);
+    repeated << std::vector<uint8_t>(4096, 'a');
+
+    auto options =
+        wired::compression_options().set_enabled(true).set_threshold(256);
+    wired::compression_stats stats;
+    auto frame = connection_t::make_frame(random, options, &stats);
+    EXPECT_GT(frame->size(), noise.size());
+    EXPECT_EQ(stats.compression_attempts(), 1);
+    EXPECT_EQ(stats.attempted_bytes(), random.head().size());
+    EXPECT_EQ(stats.compressed_messages(), 0);
+    EXPECT_EQ(stats.bytes_saved(), 0);
+
+    frame = connection_t::make_frame(repeated, options, &stats);
+    EXPECT_LT(frame->size(), 4096 / 4);
+    EXPECT_EQ(stats.compression_attempts(), 2);
+    EXPECT_EQ(stats.compressed_messages(), 1);
+    EXPECT_GT(stats.bytes_saved(), 4096 / 2);
+}
@@ -7,12 +7,18 @@
 #include <thread>
 #include <mutex>
 
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
 class connection_tests_fixture : public ::testing::Test {
   public:
     using message_t = wired::message<message_type>;
     using connection_t = wired::connection<message_type>;
     using connection_ptr = std::shared_ptr<connection_t>;
     using ts_deque = wired::ts_deque<message_t>;
+    using mpsc_queue = wired::mpsc_queue<message_t>;
 
   public:
     connection_tests_fixture()
@@ -56,7 +62,7 @@ class connection_tests_fixture : public ::testing::Test {
             if (!ec) {
                 server_conn = std::make_shared<connection_t>(
                     io_context, ssl_context_server, std::move(socket),
-                    server_incoming_messages, placeholder_cv);
+                    server_incoming_messages, server_options);
                 WIRED_LOG_MESSAGE(wired::LOG_INFO,
                                   "Server accepted connection with address: {}",
                                   (void*)server_conn.get());
@@ -95,7 +101,7 @@ class connection_tests_fixture : public ::testing::Test {
 
         client_conn = std::make_shared<connection_t>(
             io_context, ssl_context_client, asio::ip::tcp::socket(io_context),
-            client_incoming_messages, placeholder_cv);
+            client_incoming_messages, client_options);
 
         asio::ip::tcp::resolver resolver(io_context);
         asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(
@@ -115,14 +121,15 @@ class connection_tests_fixture : public ::testing::Test {
     void TearDown() override {}
 
   protected:
-    std::condition_variable placeholder_cv;
     asio::io_context io_context;
     asio::ssl::context ssl_context_client{asio::ssl::context::tls_client};
     asio::ssl::context ssl_context_server{asio::ssl::context::tls_server};
+    wired::connection_options server_options;
+    wired::connection_options client_options;
     connection_ptr server_conn;
     connection_ptr client_conn;
-    ts_deque server_incoming_messages;
-    ts_deque client_incoming_messages;
+    mpsc_queue server_incoming_messages;
+    mpsc_queue client_incoming_messages;
     asio::executor_work_guard<asio::io_context::executor_type> idle_work;
     std::thread io_thread;
 };
@@ -164,4 +171,607 @@ TEST_F(connection_tests_fixture, server_send) {
     future.wait();
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
     EXPECT_GT(client_conn->incoming_messages_count(), 0);
-}
\ No newline at end of file
+}
+
+TEST_F(connection_tests_fixture, client_send_batch) {
+    std::vector<std::future<bool>> futures;
+    for (int i = 0; i < 100; ++i) {
+        message_t msg(message_type::single);
+        msg << i;
+        futures.push_back(
+            client_conn->send(msg, wired::message_strategy::normal));
+    }
+    for (auto& future : futures) {
+        EXPECT_TRUE(future.get());
+    }
+    for (int retries = 0;
+         retries < 50 && server_conn->incoming_messages_count() < 100;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), 100);
+    for (int i = 0; i < 100; ++i) {
+        message_t msg;
+        ASSERT_TRUE(server_incoming_messages.try_pop(msg));
+        int value;
+        msg >> value;
+        EXPECT_EQ(value, i);
+    }
+}
+
+TEST_F(connection_tests_fixture, client_send_straddling_frames) {
+    std::vector<int> payload(1000);
+    std::vector<std::future<bool>> futures;
+    for (int i = 0; i < 100; ++i) {
+        std::fill(payload.begin(), payload.end(), i);
+        message_t msg(message_type::vector);
+        msg << payload;
+        futures.push_back(
+            client_conn->send(msg, wired::message_strategy::normal));
+    }
+    for (auto& future : futures) {
+        EXPECT_TRUE(future.get());
+    }
+    for (int retries = 0;
+         retries < 100 && server_conn->incoming_messages_count() < 100;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), 100);
+    for (int i = 0; i < 100; ++i) {
+        message_t msg;
+        ASSERT_TRUE(server_incoming_messages.try_pop(msg));
+        std::vector<int> received;
+        msg >> received;
+        ASSERT_EQ(received.size(), payload.size());
+        EXPECT_EQ(received.front(), i);
+        EXPECT_EQ(received.back(), i);
+    }
+}
+
+TEST_F(connection_tests_fixture, client_send_larger_than_receive_buffer) {
+    std::vector<int> payload(256 * 1024);
+    for (std::size_t i = 0; i < payload.size(); ++i) {
+        payload[i] = static_cast<int>(i);
+    }
+    message_t msg(message_type::vector);
+    msg << payload;
+    auto future = client_conn->send(msg, wired::message_strategy::normal);
+    EXPECT_TRUE(future.get());
+    for (int retries = 0;
+         retries < 100 && server_conn->incoming_messages_count() < 1;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), 1);
+    message_t received_msg;
+    ASSERT_TRUE(server_incoming_messages.try_pop(received_msg));
+    std::vector<int> received;
+    received_msg >> received;
+    EXPECT_EQ(received, payload);
+}
+
+TEST_F(connection_tests_fixture, client_post) {
+    for (int i = 0; i < 100; ++i) {
+        message_t msg(message_type::single);
+        msg << i;
+        client_conn->post(msg, wired::message_strategy::normal);
+    }
+    for (int retries = 0;
+         retries < 50 && server_conn->incoming_messages_count() < 100;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), 100);
+    for (int i = 0; i < 100; ++i) {
+        message_t msg;
+        ASSERT_TRUE(server_incoming_messages.try_pop(msg));
+        int value;
+        msg >> value;
+        EXPECT_EQ(value, i);
+    }
+}
+
+TEST_F(connection_tests_fixture, client_send_callback) {
+    std::atomic<int> succeeded = 0;
+    for (int i = 0; i < 100; ++i) {
+        message_t msg(message_type::single);
+        msg << i;
+        client_conn->send(msg, wired::message_strategy::normal,
+                          [&succeeded](bool sent) {
+                              if (sent) {
+                                  ++succeeded;
+                              }
+                          });
+    }
+    for (int retries = 0; retries < 50 && succeeded < 100; ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(succeeded, 100);
+}
+
+TEST_F(connection_tests_fixture, client_send_shared_frame) {
+    message_t msg(message_type::single);
+    msg << std::vector<int>(1024, 7);
+    auto frame = connection_t::make_frame(msg);
+    std::vector<std::future<bool>> futures;
+    for (int i = 0; i < 10; ++i) {
+        futures.push_back(
+            client_conn->send(frame, wired::message_strategy::normal));
+    }
+    for (auto& future : futures) {
+        EXPECT_TRUE(future.get());
+    }
+    // Promises are fulfilled just before the batch drops its references
+    for (int retries = 0; retries < 50 && frame.use_count() > 1; ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(frame.use_count(), 1);
+    for (int retries = 0;
+         retries < 50 && server_conn->incoming_messages_count() < 10;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), 10);
+    for (int i = 0; i < 10; ++i) {
+        message_t received;
+        ASSERT_TRUE(server_incoming_messages.try_pop(received));
+        std::vector<int> values;
+        received >> values;
+        EXPECT_EQ(values, std::vector<int>(1024, 7));
+    }
+}
+
+TEST_F(connection_tests_fixture, receive_body_pool) {
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 10; ++i) {
+            message_t msg(message_type::single);
+            msg << i;
+            EXPECT_TRUE(
+                client_conn->send(msg, wired::message_strategy::normal).get());
+        }
+        for (int retries = 0;
+             retries < 50 && server_conn->incoming_messages_count() < 10;
+             ++retries) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ(server_conn->incoming_messages_count(), 10);
+        server_incoming_messages.clear();
+    }
+    // Every body of the second round reuses one released by the first
+    ASSERT_TRUE(server_conn->body_pool());
+    EXPECT_GE(server_conn->body_pool()->hits(), 10);
+}
+
+TEST_F(connection_tests_fixture, client_send_stream) {
+    constexpr std::size_t total = 300000;
+    constexpr std::size_t chunk_size = 64 * 1024;
+    std::size_t produced = 0;
+    auto source = [&produced](uint8_t* buffer, std::size_t capacity) {
+        std::size_t bytes = std::min(capacity, total - produced);
+        for (std::size_t i = 0; i < bytes; ++i) {
+            buffer[i] = static_cast<uint8_t>(produced + i);
+        }
+        produced += bytes;
+        return bytes;
+    };
+    EXPECT_TRUE(client_conn
+                    ->send_stream(message_type::vector, source, chunk_size,
+                                  wired::message_strategy::normal)
+                    .get());
+
+    constexpr std::size_t chunks = total / chunk_size + 1;
+    for (int retries = 0;
+         retries < 50 && server_conn->incoming_messages_count() < chunks;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), chunks);
+    std::size_t received = 0;
+    uint64_t stream = 0;
+    for (std::size_t i = 0; i < chunks; ++i) {
+        message_t chunk;
+        ASSERT_TRUE(server_incoming_messages.try_pop(chunk));
+        ASSERT_TRUE(chunk.head().is_chunk());
+        if (i == 0) {
+            stream = chunk.head().stream();
+        }
+        EXPECT_EQ(chunk.head().stream(), stream);
+        EXPECT_EQ(chunk.head().final_chunk(), i == chunks - 1);
+        EXPECT_LE(chunk.body().data().size(), chunk_size);
+        for (uint8_t byte : chunk.body().data()) {
+            ASSERT_EQ(byte, static_cast<uint8_t>(received));
+            ++received;
+        }
+    }
+    EXPECT_EQ(received, total);
+}
+
+class connection_limits_tests_fixture : public connection_tests_fixture {
+  public:
+    connection_limits_tests_fixture() {
+        server_options.set_max_frame_size(1024);
+    }
+};
+
+TEST_F(connection_limits_tests_fixture, oversized_frame_disconnects) {
+    message_t msg(message_type::vector);
+    msg << std::vector<uint8_t>(4096, 1);
+    client_conn->send(msg, wired::message_strategy::normal).get();
+    for (int retries = 0; retries < 50 && server_conn->is_connected();
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(server_conn->is_connected());
+    EXPECT_EQ(server_conn->incoming_messages_count(), 0);
+}
+
+class connection_compression_tests_fixture : public connection_tests_fixture {
+  public:
+    connection_compression_tests_fixture() {
+        client_options.set_compression(
+            wired::compression_options().set_enabled(true).set_threshold(
+                256));
+    }
+};
+
+TEST_F(connection_compression_tests_fixture, client_send_compressed) {
+    std::string text;
+    for (int i = 0; i < 100; ++i) {
+        text += "state update " + std::to_string(i % 10) + "; ";
+    }
+    message_t large(message_type::vector);
+    large << text;
+    message_t small(message_type::single);
+    small << int(42);
+    EXPECT_TRUE(
+        client_conn->send(large, wired::message_strategy::normal).get());
+    EXPECT_TRUE(
+        client_conn->send(small, wired::message_strategy::normal).get());
+
+    const auto& sent = client_conn->compression_stats();
+    EXPECT_EQ(sent.compressed_messages(), 1);
+    EXPECT_GT(sent.bytes_saved(), text.size() / 2);
+
+    for (int retries = 0;
+         retries < 50 && server_conn->incoming_messages_count() < 2;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(server_conn->incoming_messages_count(), 2);
+    message_t received;
+    ASSERT_TRUE(server_incoming_messages.try_pop(received));
+    EXPECT_FALSE(received.head().compressed());
+    std::string text_out;
+    received >> text_out;
+    EXPECT_EQ(text_out, text);
+    ASSERT_TRUE(server_incoming_messages.try_pop(received));
+    int value;
+    received >> value;
+    EXPECT_EQ(value, 42);
+    EXPECT_EQ(server_conn->compression_stats().decompressed_messages(), 1);
+}
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+// The receiving end only starts reading when the test says so, until then
+// the sender's socket buffers fill up and its outgoing queue backs up
+class connection_send_queue_tests_fixture : public ::testing::Test {
+  public:
+    using message_t = wired::message<message_type>;
+    using connection_t = wired::connection<message_type>;
+    using mpsc_queue = wired::mpsc_queue<message_t>;
+
+    static constexpr int message_count = 200;
+    static constexpr std::size_t body_size = 8 * 1024;
+
+    connection_send_queue_tests_fixture()
+        : io_context(), idle_work(io_context.get_executor()),
+          io_thread([&]() { io_context.run(); }) {}
+
+    ~connection_send_queue_tests_fixture() {
+        io_context.stop();
+        io_thread.join();
+    }
+
+  protected:
+    void open(const wired::send_queue_options& limits,
+              const wired::connection_options& receiver_options =
+                  wired::connection_options()) {
+        asio::local::stream_protocol::socket sender_socket(io_context);
+        asio::local::stream_protocol::socket receiver_socket(io_context);
+        asio::local::connect_pair(sender_socket, receiver_socket);
+        sender_socket.set_option(asio::socket_base::send_buffer_size(4096));
+        sender = std::make_shared<connection_t>(
+            io_context, std::move(sender_socket), sender_incoming,
+            wired::connection_options().set_send_queue(limits));
+        receiver = std::make_shared<connection_t>(
+            io_context, std::move(receiver_socket), receiver_incoming,
+            receiver_options);
+    }
+
+    static message_t numbered(int number) {
+        message_t msg(message_type::vector);
+        msg << std::vector<uint8_t>(body_size, static_cast<uint8_t>(number))
+            << number;
+        return msg;
+    }
+
+    std::vector<int> receive(std::size_t count) {
+        for (int retries = 0;
+             retries < 500 && receiver_incoming.size() < count; ++retries) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::vector<int> numbers;
+        message_t msg;
+        while (receiver_incoming.try_pop(msg)) {
+            int number;
+            msg >> number;
+            numbers.push_back(number);
+        }
+        return numbers;
+    }
+
+    // Pops as soon as anything arrives so the inbox drains while the
+    // strand decides to pause, returns how many messages came in order
+    int drain_eagerly(int count) {
+        std::vector<message_t> batch;
+        int expected = 0;
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (expected < count &&
+               std::chrono::steady_clock::now() < deadline) {
+            receiver->take_turn(batch, count);
+            if (batch.empty()) {
+                std::this_thread::yield();
+            }
+            for (auto& msg : batch) {
+                int number;
+                msg >> number;
+                if (number != expected) {
+                    return expected;
+                }
+                ++expected;
+            }
+            batch.clear();
+        }
+        return expected;
+    }
+
+    void wait_for_drops(uint64_t drops) {
+        for (int retries = 0;
+             retries < 500 && sender->dropped_messages() < drops; ++retries) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    asio::io_context io_context;
+    mpsc_queue sender_incoming;
+    mpsc_queue receiver_incoming;
+    std::shared_ptr<connection_t> sender;
+    std::shared_ptr<connection_t> receiver;
+    asio::executor_work_guard<asio::io_context::executor_type> idle_work;
+    std::thread io_thread;
+};
+
+TEST_F(connection_send_queue_tests_fixture, reject_until_drained) {
+    open(wired::send_queue_options().set_high_watermark_bytes(64 * 1024));
+    std::promise<void> drained;
+    std::atomic<bool> notified{false};
+    sender->set_drain_handler([&]() {
+        // The queue may already drain once while the socket buffers fill
+        if (!notified.exchange(true)) {
+            drained.set_value();
+        }
+    });
+
+    std::vector<std::future<bool>> results;
+    for (int i = 0; i < message_count; ++i) {
+        results.push_back(
+            sender->send(numbered(i), wired::message_strategy::normal));
+    }
+    wait_for_drops(message_count / 2);
+    EXPECT_FALSE(sender->writable());
+    EXPECT_GE(sender->dropped_messages(), message_count / 2);
+    EXPECT_LE(sender->queued_bytes(), 64 * 1024 + 2 * body_size);
+
+    receiver->start_listening();
+    ASSERT_EQ(drained.get_future().wait_for(std::chrono::seconds(5)),
+              std::future_status::ready);
+    std::size_t sent = 0;
+    for (auto& result : results) {
+        sent += result.get() ? 1 : 0;
+    }
+    EXPECT_EQ(sent + sender->dropped_messages(), message_count);
+    EXPECT_TRUE(sender->writable());
+    EXPECT_EQ(sender->queued_bytes(), 0);
+    EXPECT_EQ(sender->queued_messages(), 0);
+    EXPECT_EQ(receive(sent).size(), sent);
+}
+
+TEST_F(connection_send_queue_tests_fixture, drop_oldest_keeps_newest) {
+    open(wired::send_queue_options()
+             .set_high_watermark_messages(4)
+             .set_overflow_policy(wired::overflow_policy::drop_oldest));
+    for (int i = 0; i < message_count; ++i) {
+        sender->post(numbered(i), wired::message_strategy::normal);
+    }
+    wait_for_drops(message_count / 2);
+    EXPECT_LE(sender->queued_messages(), 5);
+
+    receiver->start_listening();
+    std::vector<int> numbers =
+        receive(message_count - sender->dropped_messages());
+    ASSERT_FALSE(numbers.empty());
+    EXPECT_EQ(numbers.size() + sender->dropped_messages(), message_count);
+    EXPECT_TRUE(std::is_sorted(numbers.begin(), numbers.end()));
+    EXPECT_EQ(numbers.back(), message_count - 1);
+}
+
+TEST_F(connection_send_queue_tests_fixture, disconnect_slow_consumer) {
+    open(wired::send_queue_options()
+             .set_high_watermark_messages(4)
+             .set_overflow_policy(wired::overflow_policy::disconnect));
+    for (int i = 0; i < message_count && sender->is_connected(); ++i) {
+        sender->post(numbered(i), wired::message_strategy::normal);
+    }
+    for (int retries = 0; retries < 500 && sender->is_connected();
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_FALSE(sender->is_connected());
+    EXPECT_GE(sender->dropped_messages(), 1);
+}
+
+TEST_F(connection_send_queue_tests_fixture, full_inbox_pauses_reading) {
+    open(wired::send_queue_options(),
+         wired::connection_options().set_inbox_capacity(8));
+    for (int i = 0; i < message_count; ++i) {
+        sender->post(numbered(i), wired::message_strategy::normal);
+    }
+    receiver->start_listening();
+    for (int retries = 0; retries < 500 && !receiver->reading_paused();
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(receiver->reading_paused());
+    EXPECT_EQ(receiver_incoming.size(), 8);
+
+    std::vector<message_t> batch;
+    EXPECT_TRUE(receiver->take_turn(batch, 5));
+    EXPECT_EQ(batch.size(), 5);
+    int expected = 0;
+    for (int retries = 0; retries < 500 && expected < message_count;
+         ++retries) {
+        receiver->take_turn(batch, message_count);
+        for (auto& msg : batch) {
+            int number;
+            msg >> number;
+            ASSERT_EQ(number, expected++);
+        }
+        batch.clear();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_EQ(expected, message_count);
+    EXPECT_FALSE(receiver->reading_paused());
+}
+
+TEST_F(connection_send_queue_tests_fixture, eager_consumer_never_stalls) {
+    // Tiny messages make the receiver pause after almost every one
+    constexpr int count = 20000;
+    for (std::size_t capacity : {1, 2}) {
+        open(wired::send_queue_options(),
+             wired::connection_options().set_inbox_capacity(capacity));
+        for (int i = 0; i < count; ++i) {
+            message_t msg(message_type::vector);
+            msg << i;
+            sender->post(std::move(msg), wired::message_strategy::normal);
+        }
+        receiver->start_listening();
+        EXPECT_EQ(drain_eagerly(count), count) << "capacity " << capacity;
+        sender->disconnect();
+        receiver->disconnect();
+    }
+}
+
+// Both ends read from the start, only the sender's coalescing holds
+// messages back
+class connection_coalescing_tests_fixture
+    : public connection_send_queue_tests_fixture {
+  protected:
+    void open(const wired::coalesce_options& coalescing) {
+        asio::local::stream_protocol::socket sender_socket(io_context);
+        asio::local::stream_protocol::socket receiver_socket(io_context);
+        asio::local::connect_pair(sender_socket, receiver_socket);
+        sender = std::make_shared<connection_t>(
+            io_context, std::move(sender_socket), sender_incoming,
+            wired::connection_options().set_coalescing(coalescing));
+        receiver = std::make_shared<connection_t>(
+            io_context, std::move(receiver_socket), receiver_incoming,
+            wired::connection_options());
+        receiver->start_listening();
+    }
+
+    static message_t small(int number) {
+        message_t msg(message_type::vector);
+        msg << number;
+        return msg;
+    }
+};
+
+TEST_F(connection_coalescing_tests_fixture, flush_writes_held_messages) {
+    open(wired::coalesce_options().set_enabled(true).set_flush_delay(
+        std::chrono::seconds(60)));
+    for (int i = 0; i < 10; ++i) {
+        sender->post(small(i), wired::message_strategy::normal);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_EQ(receiver_incoming.size(), 0);
+    EXPECT_EQ(sender->queued_messages(), 10);
+
+    sender->flush();
+    std::vector<int> numbers = receive(10);
+    ASSERT_EQ(numbers.size(), 10);
+    EXPECT_TRUE(std::is_sorted(numbers.begin(), numbers.end()));
+    EXPECT_EQ(sender->queued_messages(), 0);
+}
+
+TEST_F(connection_coalescing_tests_fixture, deadline_writes_held_messages) {
+    open(wired::coalesce_options().set_enabled(true).set_flush_delay(
+        std::chrono::milliseconds(20)));
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        sender->post(small(i), wired::message_strategy::normal);
+    }
+    EXPECT_EQ(receive(10).size(), 10);
+    EXPECT_GE(std::chrono::steady_clock::now() - start,
+              std::chrono::milliseconds(20));
+}
+
+TEST_F(connection_coalescing_tests_fixture, disconnect_cancels_deadline) {
+    open(wired::coalesce_options().set_enabled(true).set_flush_delay(
+        std::chrono::seconds(60)));
+    sender->post(small(0), wired::message_strategy::normal);
+    sender->disconnect().wait();
+    // Only the fixture holds the sender once the deadline wait is gone
+    for (int retries = 0; retries < 500 && sender.use_count() > 1;
+         ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(sender.use_count(), 1);
+}
+
+TEST_F(connection_coalescing_tests_fixture, threshold_and_control_skip_wait) {
+    open(wired::coalesce_options()
+             .set_enabled(true)
+             .set_flush_bytes(body_size)
+             .set_flush_delay(std::chrono::seconds(60)));
+    sender->post(small(0), wired::message_strategy::control);
+    EXPECT_EQ(receive(1).size(), 1);
+    sender->post(numbered(1), wired::message_strategy::normal);
+    EXPECT_EQ(receive(1).size(), 1);
+}
+
+TEST_F(connection_coalescing_tests_fixture, socket_options_applied) {
+    asio::ip::tcp::acceptor acceptor(
+        io_context,
+        asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+    asio::ip::tcp::socket client_socket(io_context);
+    client_socket.connect(acceptor.local_endpoint());
+    asio::ip::tcp::socket accepted = acceptor.accept();
+    int fd = accepted.native_handle();
+    auto conn = std::make_shared<connection_t>(
+        io_context, std::move(accepted), sender_incoming,
+        wired::connection_options().set_socket(
+            wired::socket_options().set_keep_alive(true).set_send_buffer_size(
+                64 * 1024)));
+
+    int value = 0;
+    socklen_t length = sizeof(value);
+    ASSERT_EQ(getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &value, &length), 0);
+    EXPECT_NE(value, 0);
+    ASSERT_EQ(getsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &value, &length), 0);
+    EXPECT_NE(value, 0);
+    ASSERT_EQ(getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &value, &length), 0);
+    EXPECT_GE(value, 64 * 1024);
+}
+#endif
@@ -0,0 +1,84 @@
+#include "wired.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class datagram_tests_fixture : public ::testing::Test {
+  public:
+    void SetUp() override {
+        std::array<uint8_t, wired::datagram_session::material_size> material;
+        for (std::size_t i = 0; i < material.size(); ++i) {
+            material[i] = static_cast<uint8_t>(i * 7 + 1);
+        }
+        ASSERT_TRUE(
+            client_.init(material.data(), wired::handshake_role::client));
+        ASSERT_TRUE(
+            server_.init(material.data(), wired::handshake_role::server));
+    }
+
+  protected:
+    wired::datagram_session client_;
+    wired::datagram_session server_;
+};
+
+TEST_F(datagram_tests_fixture, seal_and_open_both_directions) {
+    std::vector<uint8_t> payload = {1, 2, 3, 4, 5};
+    std::vector<uint8_t> received;
+
+    auto packet = client_.seal(payload.data(), payload.size());
+    EXPECT_EQ(packet.size(), wired::datagram_session::header_size +
+                                 payload.size() +
+                                 wired::datagram_session::tag_size);
+    uint64_t channel = 0;
+    ASSERT_TRUE(wired::datagram_session::peek_channel(packet, channel));
+    EXPECT_EQ(channel, server_.channel());
+    ASSERT_TRUE(server_.open(packet, received));
+    EXPECT_EQ(received, payload);
+
+    packet = server_.seal(payload.data(), payload.size());
+    ASSERT_TRUE(client_.open(packet, received));
+    EXPECT_EQ(received, payload);
+
+    // A peer cannot open its own datagrams, each direction has its own key
+    packet = client_.seal(payload.data(), payload.size());
+    EXPECT_FALSE(client_.open(packet, received));
+
+    packet = client_.seal(nullptr, 0);
+    ASSERT_TRUE(server_.open(packet, received));
+    EXPECT_TRUE(received.empty());
+}
+
+TEST_F(datagram_tests_fixture, drops_stale_and_replayed_datagrams) {
+    std::vector<uint8_t> payload = {9, 8, 7};
+    std::vector<uint8_t> received;
+
+    auto first = client_.seal(payload.data(), payload.size());
+    auto second = client_.seal(payload.data(), payload.size());
+    ASSERT_TRUE(server_.open(second, received));
+    EXPECT_FALSE(server_.open(first, received));
+    EXPECT_FALSE(server_.open(second, received));
+
+    auto third = client_.seal(payload.data(), payload.size());
+    EXPECT_TRUE(server_.open(third, received));
+}
+
+TEST_F(datagram_tests_fixture, drops_tampered_datagrams) {
+    std::vector<uint8_t> payload = {1, 1, 2, 3, 5, 8};
+    std::vector<uint8_t> received;
+
+    for (std::size_t i = 0; i < wired::datagram_session::header_size +
+                                    payload.size() +
+                                    wired::datagram_session::tag_size;
+         ++i) {
+        auto packet = client_.seal(payload.data(), payload.size());
+        packet[i] ^= 0x01;
+        EXPECT_FALSE(server_.open(packet, received)) << "byte " << i;
+    }
+    // A rejected datagram does not move the window forward
+    auto packet = client_.seal(payload.data(), payload.size());
+    EXPECT_TRUE(server_.open(packet, received));
+    EXPECT_EQ(received, payload);
+}
@@ -0,0 +1,129 @@
+#include "wired.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+
+void wait_for(const std::atomic<int>& counter, int expected) {
+    for (int retries = 0; retries < 500 && counter < expected; ++retries) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+} // namespace
+
+TEST(dispatcher_tests, keeps_order_per_key) {
+    constexpr int keys = 8;
+    constexpr int tasks_per_key = 500;
+    std::array<std::vector<int>, keys> seen;
+    std::atomic<int> done{0};
+    {
+        wired::ordered_dispatcher dispatcher(4);
+        for (int i = 0; i < tasks_per_key; ++i) {
+            for (int key = 0; key < keys; ++key) {
+                dispatcher.submit(key, [&seen, &done, key, i]() {
+                    seen[key].push_back(i);
+                    ++done;
+                });
+            }
+        }
+        wait_for(done, keys * tasks_per_key);
+    }
+    ASSERT_EQ(done, keys * tasks_per_key);
+    for (const auto& values : seen) {
+        ASSERT_EQ(values.size(), tasks_per_key);
+        for (int i = 0; i < tasks_per_key; ++i) {
+            EXPECT_EQ(values[i], i);
+        }
+    }
+}
+
+TEST(dispatcher_tests, runs_different_keys_in_parallel) {
+    std::atomic<int> running{0};
+    std::atomic<int> max_running{0};
+    std::atomic<int> done{0};
+    {
+        wired::ordered_dispatcher dispatcher(2);
+        for (int key = 1; key <= 2; ++key) {
+            dispatcher.submit(key, [&]() {
+                int now = ++running;
+                max_running = std::max(max_running.load(), now);
+                for (int retries = 0; retries < 200 && running < 2;
+                     ++retries) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+                max_running = std::max(max_running.load(), running.load());
+                ++done;
+            });
+        }
+        wait_for(done, 2);
+    }
+    EXPECT_EQ(max_running, 2);
+}
+
+TEST(dispatcher_tests, hot_key_does_not_block_others) {
+    std::atomic<int> hot_done{0};
+    std::atomic<int> cold_done{0};
+    int hot_done_when_cold_finished = 0;
+    {
+        wired::ordered_dispatcher dispatcher(2);
+        for (int i = 0; i < 200; ++i) {
+            dispatcher.submit(0, [&hot_done]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                ++hot_done;
+            });
+        }
+        for (int key = 1; key <= 32; ++key) {
+            dispatcher.submit(key, [&cold_done]() { ++cold_done; });
+        }
+        wait_for(cold_done, 32);
+        hot_done_when_cold_finished = hot_done;
+        wait_for(hot_done, 200);
+    }
+    EXPECT_EQ(cold_done, 32);
+    EXPECT_EQ(hot_done, 200);
+    EXPECT_LT(hot_done_when_cold_finished, 200);
+}
+
+TEST(dispatcher_tests, throwing_task_keeps_lane_running) {
+    std::atomic<int> done{0};
+    {
+        wired::ordered_dispatcher dispatcher(1);
+        dispatcher.submit(0, []() { throw 42; });
+        dispatcher.submit(0, []() { throw std::runtime_error("failed"); });
+        dispatcher.submit(0, [&done]() { ++done; });
+        wait_for(done, 1);
+    }
+    EXPECT_EQ(done, 1);
+}
+
+TEST(dispatcher_tests, stop_discards_waiting_tasks) {
+    std::atomic<int> started{0};
+    std::atomic<bool> release{false};
+    wired::ordered_dispatcher dispatcher(1);
+    dispatcher.submit(0, [&]() {
+        ++started;
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    for (int i = 0; i < 10; ++i) {
+        dispatcher.submit(0, [&started]() { ++started; });
+    }
+    wait_for(started, 1);
+    std::thread releaser([&release]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        release = true;
+    });
+    dispatcher.stop();
+    releaser.join();
+    EXPECT_EQ(started, 1);
+    EXPECT_EQ(dispatcher.pending(), 0);
+}
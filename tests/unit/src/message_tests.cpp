@@ -170,4 +170,147 @@ TEST_F(message_tests_fixture, reset) {
     EXPECT_EQ(msg.head().size(), 0);
     EXPECT_EQ(msg.head().timestamp(), 0);
     EXPECT_EQ(msg.body().data().size(), 0);
-}
\ No newline at end of file
+}
+TEST_F(message_tests_fixture, forward_single_multi) {
+    msg.encoding(wired::message_encoding::forward);
+    msg << int(42) << int(43) << int(44);
+    int value1;
+    int value2;
+    int value3;
+    msg >> value1 >> value2 >> value3;
+    EXPECT_EQ(value1, 42);
+    EXPECT_EQ(value2, 43);
+    EXPECT_EQ(value3, 44);
+    EXPECT_EQ(msg.body().data().size(), 3 * sizeof(int));
+    EXPECT_EQ(msg.head().size(), msg.body().data().size());
+    EXPECT_THROW(msg >> value1, std::out_of_range);
+}
+
+TEST_F(message_tests_fixture, forward_vector_multi) {
+    wired::message<message_type> forward(message_type::vector,
+                                         wired::message_encoding::forward);
+    forward << vector1 << vector2;
+    std::vector<int> vector3;
+    std::vector<int> vector4;
+    forward >> vector3 >> vector4;
+    EXPECT_EQ(vector1, vector3);
+    EXPECT_EQ(vector2, vector4);
+    EXPECT_EQ(forward.body().data().size(),
+              vector1.size() * sizeof(int) + sizeof(size_t) +
+                  vector2.size() * sizeof(int) + sizeof(size_t));
+}
+
+TEST_F(message_tests_fixture, forward_rewind) {
+    msg.encoding(wired::message_encoding::forward);
+    msg << int(42) << vector1;
+    for (int pass = 0; pass < 2; ++pass) {
+        int value;
+        std::vector<int> vector3;
+        msg >> value >> vector3;
+        EXPECT_EQ(value, 42);
+        EXPECT_EQ(vector3, vector1);
+        EXPECT_EQ(msg.read_offset(), msg.body().data().size());
+        msg.rewind();
+    }
+}
+
+TEST_F(message_tests_fixture, contiguous_range_layout) {
+    msg << vector1;
+    const auto& body = msg.body().data();
+    ASSERT_EQ(body.size(), vector1.size() * sizeof(int) + sizeof(uint64_t));
+    EXPECT_EQ(std::memcmp(body.data(), vector1.data(),
+                          vector1.size() * sizeof(int)),
+              0);
+    const uint8_t* length = body.data() + vector1.size() * sizeof(int);
+    EXPECT_EQ(length[0], vector1.size());
+    EXPECT_EQ(wired::schema_codec::get_u64(length), vector1.size());
+}
+
+TEST_F(message_tests_fixture, contiguous_range_round_trip) {
+    std::string text = "hello wired";
+    std::vector<float> samples = {0.5f, 1.5f, 2.5f};
+    std::vector<std::string> words = {"a", "bb", "ccc"};
+    for (auto encoding :
+         {wired::message_encoding::stack, wired::message_encoding::forward}) {
+        wired::message<message_type> round_trip(message_type::vector,
+                                                encoding);
+        round_trip << text << samples << words;
+        std::string text_out;
+        std::vector<float> samples_out;
+        std::vector<std::string> words_out;
+        if (encoding == wired::message_encoding::stack) {
+            round_trip >> words_out >> samples_out >> text_out;
+        } else {
+            round_trip >> text_out >> samples_out >> words_out;
+        }
+        EXPECT_EQ(text_out, text);
+        EXPECT_EQ(samples_out, samples);
+        EXPECT_EQ(words_out, words);
+    }
+}
+
+TEST_F(message_tests_fixture, contiguous_range_length_check) {
+    msg << uint64_t(1000);
+    std::vector<int> vector3;
+    EXPECT_THROW(msg >> vector3, std::out_of_range);
+}
+
+TEST_F(message_tests_fixture, header_wire_round_trip) {
+    using header_t = wired::message_header<message_type>;
+    using decode_status = header_t::decode_status;
+
+    msg.id(message_type::vector);
+    msg << int(42);
+    uint8_t buffer[header_t::max_wire_size];
+    std::size_t written = msg.head().encode(buffer);
+    EXPECT_EQ(written, 3);
+    EXPECT_EQ(written, msg.head().wire_size());
+
+    header_t decoded;
+    std::size_t consumed = 0;
+    EXPECT_EQ(decoded.decode(buffer, written - 1, consumed),
+              decode_status::incomplete);
+    ASSERT_EQ(decoded.decode(buffer, written, consumed),
+              decode_status::complete);
+    EXPECT_EQ(consumed, written);
+    EXPECT_EQ(decoded.id(), message_type::vector);
+    EXPECT_EQ(decoded.size(), sizeof(int));
+    EXPECT_EQ(decoded.timestamp(), 0);
+}
+
+TEST_F(message_tests_fixture, header_wire_timestamp_and_large_size) {
+    using header_t = wired::message_header<message_type>;
+    using decode_status = header_t::decode_status;
+
+    header_t header(message_type::single);
+    header.sync(300000);
+    header.timestamp(0x0102030405060708);
+    uint8_t buffer[header_t::max_wire_size];
+    std::size_t written = header.encode(buffer);
+    EXPECT_EQ(written, 1 + 1 + 3 + sizeof(uint64_t));
+    EXPECT_EQ(buffer[written - sizeof(uint64_t)], 0x08);
+
+    header_t decoded;
+    std::size_t consumed = 0;
+    ASSERT_EQ(decoded.decode(buffer, written, consumed),
+              decode_status::complete);
+    EXPECT_EQ(decoded.size(), 300000);
+    EXPECT_EQ(decoded.timestamp(), 0x0102030405060708);
+}
+
+TEST_F(message_tests_fixture, header_wire_invalid) {
+    using header_t = wired::message_header<message_type>;
+    using decode_status = header_t::decode_status;
+
+    header_t decoded;
+    std::size_t consumed = 0;
+    uint8_t wrong_version[] = {0x20, 0x00, 0x00};
+    EXPECT_EQ(decoded.decode(wrong_version, sizeof(wrong_version), consumed),
+              decode_status::invalid);
+
+    uint8_t overlong[header_t::max_wire_size];
+    std::memset(overlong, 0xff, sizeof(overlong));
+    overlong[0] = header_t::wire_version << 4;
+    EXPECT_EQ(decoded.decode(overlong, sizeof(overlong), consumed),
+              decode_status::invalid);
+}
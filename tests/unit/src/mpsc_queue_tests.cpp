@@ -0,0 +1,90 @@
+#include "wired.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+TEST(mpsc_queue_tests, push_and_try_pop) {
+    wired::mpsc_queue<std::string> queue;
+    EXPECT_TRUE(queue.empty());
+    queue.push("first");
+    queue.push(std::string(3, 'x'));
+    EXPECT_EQ(queue.size(), 2);
+    EXPECT_FALSE(queue.empty());
+
+    std::string value;
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(value, "first");
+    ASSERT_TRUE(queue.try_pop(value));
+    EXPECT_EQ(value, "xxx");
+    EXPECT_FALSE(queue.try_pop(value));
+    EXPECT_EQ(queue.size(), 0);
+}
+
+TEST(mpsc_queue_tests, try_pop_n) {
+    wired::mpsc_queue<int> queue;
+    for (int i = 0; i < 10; ++i) {
+        queue.push(i);
+    }
+    std::vector<int> values;
+    EXPECT_EQ(queue.try_pop_n(std::back_inserter(values), 4), 4);
+    EXPECT_EQ(queue.try_pop_n(std::back_inserter(values), 100), 6);
+    EXPECT_EQ(queue.try_pop_n(std::back_inserter(values), 100), 0);
+    ASSERT_EQ(values.size(), 10);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(values[i], i);
+    }
+}
+
+TEST(mpsc_queue_tests, moves_values_out) {
+    wired::mpsc_queue<std::unique_ptr<int>> queue;
+    queue.push(std::make_unique<int>(42));
+    std::unique_ptr<int> value;
+    ASSERT_TRUE(queue.try_pop(value));
+    ASSERT_NE(value, nullptr);
+    EXPECT_EQ(*value, 42);
+}
+
+TEST(mpsc_queue_tests, multiple_producers_keep_per_producer_order) {
+    constexpr int producers = 4;
+    constexpr int per_producer = 10000;
+    wired::mpsc_queue<std::pair<int, int>> queue;
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&queue, p]() {
+            for (int i = 0; i < per_producer; ++i) {
+                queue.push(p, i);
+            }
+        });
+    }
+
+    std::vector<int> next(producers, 0);
+    int received = 0;
+    while (received < producers * per_producer) {
+        std::pair<int, int> value;
+        if (!queue.try_pop(value)) {
+            queue.wait();
+            continue;
+        }
+        EXPECT_EQ(value.second, next[value.first]);
+        ++next[value.first];
+        ++received;
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(mpsc_queue_tests, wake_releases_waiting_consumer) {
+    wired::mpsc_queue<int> queue;
+    std::thread waker([&queue]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        queue.wake();
+    });
+    queue.wait();
+    waker.join();
+    EXPECT_TRUE(queue.empty());
+}
@@ -0,0 +1,82 @@
+#include "wired.h"
+
+#include "test_enums.h"
+#include "test_types.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+using message_t = wired::message<message_type>;
+
+static_assert(wired::schema_codec::is_fixed<schema_point>());
+static_assert(wired::schema_codec::fixed_size<schema_point>() ==
+              2 * sizeof(int32_t));
+static_assert(!wired::schema_codec::is_fixed<schema_player>());
+
+schema_player make_player() {
+    return schema_player{7, {3, -4}, "wired", {0.5f, 1.5f}, {"a", "bb"}};
+}
+
+void expect_equal(const schema_player& a, const schema_player& b) {
+    EXPECT_EQ(a.id, b.id);
+    EXPECT_EQ(a.position.x, b.position.x);
+    EXPECT_EQ(a.position.y, b.position.y);
+    EXPECT_EQ(a.name, b.name);
+    EXPECT_EQ(a.samples, b.samples);
+    EXPECT_EQ(a.tags, b.tags);
+}
+
+TEST(schema_tests, exact_size) {
+    schema_player player = make_player();
+    std::size_t expected = sizeof(uint32_t) + 2 * sizeof(int32_t) +
+                           sizeof(uint64_t) + player.name.size() +
+                           sizeof(uint64_t) + 2 * sizeof(float) +
+                           sizeof(uint64_t) + 2 * sizeof(uint64_t) + 3;
+    EXPECT_EQ(wired::schema_codec::size(player), expected);
+
+    message_t msg(message_type::single, wired::message_encoding::forward);
+    msg << player;
+    EXPECT_EQ(msg.body().data().size(), expected);
+    EXPECT_EQ(msg.head().size(), expected);
+}
+
+TEST(schema_tests, fixed_round_trip_stack) {
+    message_t msg(message_type::single);
+    msg << schema_point{1, 2} << schema_point{3, 4};
+    EXPECT_EQ(msg.body().data().size(), 4 * sizeof(int32_t));
+    schema_point first;
+    schema_point second;
+    msg >> second >> first;
+    EXPECT_EQ(first.x, 1);
+    EXPECT_EQ(first.y, 2);
+    EXPECT_EQ(second.x, 3);
+    EXPECT_EQ(second.y, 4);
+    EXPECT_EQ(msg.body().data().size(), 0);
+}
+
+TEST(schema_tests, variable_round_trip) {
+    for (auto encoding :
+         {wired::message_encoding::stack, wired::message_encoding::forward}) {
+        message_t msg(message_type::single, encoding);
+        msg << make_player() << int(42);
+        schema_player player;
+        int value;
+        if (encoding == wired::message_encoding::stack) {
+            msg >> value >> player;
+        } else {
+            msg >> player >> value;
+        }
+        expect_equal(player, make_player());
+        EXPECT_EQ(value, 42);
+    }
+}
+
+TEST(schema_tests, truncated_body) {
+    message_t msg(message_type::single, wired::message_encoding::forward);
+    msg << make_player();
+    msg.body().data().resize(msg.body().data().size() - 1);
+    schema_player player;
+    EXPECT_THROW(msg >> player, std::out_of_range);
+}
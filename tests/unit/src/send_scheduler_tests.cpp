@@ -0,0 +1,98 @@
+#include "wired.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+using scheduler_t = wired::send_scheduler<int>;
+
+namespace {
+
+std::vector<std::size_t> drain_levels(scheduler_t& scheduler,
+                                      std::size_t count) {
+    std::vector<std::size_t> levels;
+    for (std::size_t i = 0; i < count && !scheduler.empty(); ++i) {
+        std::size_t level = scheduler.select();
+        scheduler.pop(level);
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+} // namespace
+
+TEST(send_scheduler_tests, strict_levels_in_priority_order) {
+    scheduler_t scheduler(
+        wired::send_scheduler_options().set_strict_levels(4));
+    scheduler.push(wired::message_strategy::bulk, 1, 10);
+    scheduler.push(wired::message_strategy::normal, 2, 10);
+    scheduler.push(wired::message_strategy::normal, 3, 10);
+    scheduler.push(wired::message_strategy::control, 4, 10);
+    scheduler.push(static_cast<wired::message_strategy>(9), 5, 10);
+
+    std::vector<int> order;
+    while (!scheduler.empty()) {
+        order.push_back(scheduler.pop(scheduler.select()));
+    }
+    EXPECT_EQ(order, (std::vector<int>{4, 2, 3, 1, 5}));
+}
+
+TEST(send_scheduler_tests, weighted_levels_share_by_weight) {
+    scheduler_t scheduler(wired::send_scheduler_options()
+                              .set_levels(2)
+                              .set_strict_levels(0)
+                              .set_weight(0, 3)
+                              .set_weight(1, 1)
+                              .set_quantum(100));
+    for (int i = 0; i < 100; ++i) {
+        scheduler.push(wired::message_strategy::control, int(i), 100);
+        scheduler.push(wired::message_strategy::high, int(i), 100);
+    }
+    std::vector<std::size_t> levels = drain_levels(scheduler, 40);
+    std::size_t first = std::count(levels.begin(), levels.end(), 0);
+    EXPECT_EQ(first, 30);
+    EXPECT_EQ(levels.size() - first, 10);
+}
+
+TEST(send_scheduler_tests, starving_level_is_promoted) {
+    scheduler_t scheduler(wired::send_scheduler_options()
+                              .set_strict_levels(4)
+                              .set_starvation_limit(4));
+    scheduler.push(wired::message_strategy::bulk, -1, 10);
+    for (int i = 0; i < 20; ++i) {
+        scheduler.push(wired::message_strategy::control, int(i), 10);
+    }
+    std::vector<std::size_t> levels = drain_levels(scheduler, 6);
+    EXPECT_EQ(levels, (std::vector<std::size_t>{0, 0, 0, 0, 3, 0}));
+    EXPECT_EQ(scheduler.stats().promotions(3), 1);
+    EXPECT_EQ(scheduler.stats().promotions(0), 0);
+}
+
+TEST(send_scheduler_tests, stats_and_eviction) {
+    scheduler_t scheduler{wired::send_scheduler_options()};
+    scheduler.push(wired::message_strategy::control, 1, 5);
+    scheduler.push(wired::message_strategy::bulk, 2, 50);
+    scheduler.push(wired::message_strategy::bulk, 3, 70);
+    const auto& stats = scheduler.stats();
+    EXPECT_EQ(stats.levels(), 4);
+    EXPECT_EQ(stats.queued_messages(3), 2);
+    EXPECT_EQ(stats.queued_bytes(3), 120);
+    EXPECT_EQ(stats.peak_messages(3), 2);
+
+    // Eviction starts at the least urgent level
+    EXPECT_EQ(scheduler.evict(false), 3);
+    EXPECT_EQ(scheduler.evict(true), 2);
+    EXPECT_EQ(scheduler.evict(true), 1);
+    EXPECT_FALSE(scheduler.evict(true).has_value());
+    EXPECT_TRUE(scheduler.empty());
+    EXPECT_EQ(stats.queued_messages(3), 0);
+    EXPECT_EQ(stats.queued_bytes(3), 0);
+    EXPECT_EQ(stats.sent_messages(3), 0);
+    EXPECT_EQ(stats.peak_messages(3), 2);
+
+    scheduler.push(wired::message_strategy::normal, 4, 8);
+    EXPECT_EQ(scheduler.pop(scheduler.select()), 4);
+    EXPECT_EQ(stats.sent_messages(2), 1);
+}
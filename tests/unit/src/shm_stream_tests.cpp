@@ -0,0 +1,123 @@
+#include "wired.h"
+
+#include <gtest/gtest.h>
+
+#if defined(WIRED_HAS_SHM_TRANSPORT)
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+// Passes count eventfds over a socket pair the way a peer hands over its
+// shm channel, receive must reject anything but a complete channel
+class shm_channel_tests_fixture : public ::testing::Test {
+  public:
+    void SetUp() override {
+        ASSERT_EQ(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets_), 0);
+    }
+
+    void TearDown() override {
+        for (int fd : sent_) {
+            ::close(fd);
+        }
+        ::close(sockets_[0]);
+        ::close(sockets_[1]);
+    }
+
+  protected:
+    void send_descriptors(std::size_t count) {
+        for (std::size_t i = 0; i < count; ++i) {
+            sent_.push_back(::eventfd(0, EFD_CLOEXEC));
+        }
+        char payload = 0;
+        iovec iov{&payload, sizeof(payload)};
+        std::vector<char> control(CMSG_SPACE(sizeof(int) * count));
+        msghdr message{};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control.data();
+        message.msg_controllen = control.size();
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        std::memcpy(CMSG_DATA(cmsg), sent_.data(), sizeof(int) * count);
+        ASSERT_EQ(::sendmsg(sockets_[0], &message, 0), 1);
+    }
+
+    static std::size_t open_descriptors() {
+        std::size_t count = 0;
+        for ([[maybe_unused]] const auto& entry :
+             std::filesystem::directory_iterator("/proc/self/fd")) {
+            ++count;
+        }
+        return count;
+    }
+
+    int sockets_[2];
+    std::vector<int> sent_;
+};
+
+TEST_F(shm_channel_tests_fixture, wrong_descriptor_count_is_closed) {
+    send_descriptors(2);
+    std::size_t before = open_descriptors();
+    asio::error_code error;
+    wired::shm_channel::receive(sockets_[1], error);
+    EXPECT_EQ(error, asio::error::invalid_argument);
+    EXPECT_EQ(open_descriptors(), before);
+}
+
+TEST_F(shm_channel_tests_fixture, truncated_descriptors_are_closed) {
+    send_descriptors(1 + wired::shm_channel::event_count + 3);
+    std::size_t before = open_descriptors();
+    asio::error_code error;
+    wired::shm_channel::receive(sockets_[1], error);
+    EXPECT_EQ(error, asio::error::invalid_argument);
+    EXPECT_EQ(open_descriptors(), before);
+}
+
+// A ring over local memory whose control block the test scribbles on the
+// way a hostile peer would
+class shm_ring_tests_fixture : public ::testing::Test {
+  public:
+    shm_ring_tests_fixture()
+        : control{{0}, {0}, {0}, {0}}, data(), ring(&control, data, 64) {}
+
+  protected:
+    wired::shm_ring_control control;
+    uint8_t data[64];
+    wired::shm_ring ring;
+};
+
+TEST_F(shm_ring_tests_fixture, tail_beyond_capacity_fails) {
+    control.tail.store(1000);
+    std::vector<uint8_t> out(64);
+    asio::error_code error;
+    EXPECT_EQ(ring.read(asio::buffer(out), error), 0);
+    EXPECT_EQ(error, asio::error::invalid_argument);
+    EXPECT_TRUE(ring.corrupted());
+    EXPECT_EQ(ring.readable(), 0);
+}
+
+TEST_F(shm_ring_tests_fixture, head_past_tail_fails) {
+    control.head.store(8);
+    std::vector<uint8_t> in(16, 1);
+    asio::error_code error;
+    EXPECT_EQ(ring.write(asio::buffer(in), error), 0);
+    EXPECT_EQ(error, asio::error::invalid_argument);
+    EXPECT_EQ(ring.writable(), 0);
+}
+
+TEST_F(shm_ring_tests_fixture, indices_running_backwards_fail) {
+    std::vector<uint8_t> in(16, 1);
+    asio::error_code error;
+    EXPECT_EQ(ring.write(asio::buffer(in), error), 16);
+    EXPECT_FALSE(error);
+    control.tail.store(4);
+    EXPECT_EQ(ring.write(asio::buffer(in), error), 0);
+    EXPECT_EQ(error, asio::error::invalid_argument);
+}
+#endif